@@ -0,0 +1,484 @@
+/*
+ * Collective operation timings, and hand-written allreduce algorithms to
+ * compare against the library's.
+ *
+ *   mpicc -O3 -o collectives_mpi collectives_mpi.c
+ *   mpirun -np <N> ./collectives_mpi [options]
+ *
+ * Options, as NAME=VALUE or in the environment as COLL_<NAME>:
+ *
+ *   ops=all        comma separated list of
+ *                    bcast, reduce, allreduce, allgather   (the library)
+ *                    ring, rd, rabenseifner                (allreduce here)
+ *   min=8 max=67108864   payload sizes in bytes, doubling, plus 24 if in
+ *                  range
+ *   iters=1000     timed repetitions per size, fewer for large payloads
+ *   csv=FILE       write the results there instead of to stdout
+ *
+ * The payload is an array of doubles summed with MPI_SUM.  For allgather
+ * it is the size of the gathered result, each rank contributing its share.
+ * The time of one operation is averaged over the repetitions on each rank;
+ * the CSV gives its minimum, mean and maximum over the ranks.  Before
+ * timing, each hand-written allreduce is checked against MPI_Allreduce.
+ *
+ * The 8 byte case is the shape of the heated plate's diff reduction, the
+ * 24 byte case that of a [pot, kin, near] energy reduction.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+/* Bytes moved per size before the repetition count is cut down. */
+#define BYTE_BUDGET (1L << 30)
+#define MIN_ITERS 5
+
+/* The payload of a [pot, kin, near] energy reduction. */
+#define ENERGY_BYTES 24
+/* Enough for a doubling sweep over any long, and ENERGY_BYTES. */
+#define MAX_SIZES 64
+
+/*
+ * Return the value of option NAME, given on the command line as NAME=VALUE
+ * or in the environment variable ENV_NAME, or NULL if it is not set.
+ * The command line takes precedence.
+ */
+static const char *option_string(int argc, char **argv, const char *name,
+                                 const char *env_name)
+{
+    size_t len = strlen(name);
+    const char *value = NULL;
+    int k;
+
+    for (k = 1; k < argc; ++k) {
+        if (strncmp(argv[k], name, len) == 0 && argv[k][len] == '=') {
+            value = argv[k] + len + 1;
+        }
+    }
+    if (value == NULL) {
+        value = getenv(env_name);
+    }
+    if (value != NULL && *value == '\0') {
+        value = NULL;
+    }
+    return value;
+}
+
+/*
+ * Return the value of the integer option NAME (see option_string), or
+ * DEFAULT_VALUE if it is not set.
+ */
+static long option_long(int argc, char **argv, const char *name,
+                        const char *env_name, long default_value)
+{
+    const char *value = option_string(argc, argv, name, env_name);
+    char *end;
+    long result;
+
+    if (value == NULL) {
+        return default_value;
+    }
+    result = strtol(value, &end, 10);
+    if (*end != '\0' || result <= 0) {
+        fprintf(stderr, "Bad value for %s: %s\n", name, value);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return result;
+}
+
+static void add(double *a, const double *b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        a[i] += b[i];
+    }
+}
+
+/*
+ * The recursive algorithms work on a power of two of ranks.  With p2 the
+ * largest power of two <= size and rem = size - p2, ranks below 2*rem
+ * pair up first: the even rank hands its data to the odd one and sits
+ * out.  Return the rank within the power of two, or -1 for those sitting
+ * out; real_rank() maps back.
+ */
+static int fold(double *buf, double *tmp, int n, int rank, int rem,
+                MPI_Comm comm)
+{
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Send(buf, n, MPI_DOUBLE, rank + 1, 0, comm);
+            return -1;
+        }
+        MPI_Recv(tmp, n, MPI_DOUBLE, rank - 1, 0, comm, MPI_STATUS_IGNORE);
+        add(buf, tmp, n);
+        return rank / 2;
+    }
+    return rank - rem;
+}
+
+static int real_rank(int newrank, int rem)
+{
+    return newrank < rem ? 2 * newrank + 1 : newrank + rem;
+}
+
+/* Give the ranks that sat out the result. */
+static void unfold(double *buf, int n, int rank, int rem, MPI_Comm comm)
+{
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Recv(buf, n, MPI_DOUBLE, rank + 1, 0, comm,
+                     MPI_STATUS_IGNORE);
+        } else {
+            MPI_Send(buf, n, MPI_DOUBLE, rank - 1, 0, comm);
+        }
+    }
+}
+
+/*
+ * Recursive doubling: log2(p) exchanges of the whole vector.  Fewest
+ * messages, so best for short vectors.
+ */
+static void allreduce_rd(const double *sbuf, double *rbuf, double *tmp,
+                         int n, MPI_Comm comm)
+{
+    int rank, size, p2, rem, newrank, mask;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    for (p2 = 1; 2 * p2 <= size; p2 *= 2) {
+    }
+    rem = size - p2;
+
+    memcpy(rbuf, sbuf, n * sizeof(double));
+    newrank = fold(rbuf, tmp, n, rank, rem, comm);
+    if (newrank >= 0) {
+        for (mask = 1; mask < p2; mask *= 2) {
+            int partner = real_rank(newrank ^ mask, rem);
+
+            MPI_Sendrecv(rbuf, n, MPI_DOUBLE, partner, 1,
+                         tmp, n, MPI_DOUBLE, partner, 1, comm,
+                         MPI_STATUS_IGNORE);
+            add(rbuf, tmp, n);
+        }
+    }
+    unfold(rbuf, n, rank, rem, comm);
+}
+
+/*
+ * Ring: a reduce-scatter then an allgather, each of p-1 steps passing one
+ * p-th of the vector to the right.  Each rank sends about 2n doubles
+ * whatever p is, so best for long vectors on many ranks.
+ */
+static void allreduce_ring(const double *sbuf, double *rbuf, double *tmp,
+                           int n, MPI_Comm comm)
+{
+    int rank, size, right, left, s;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    right = (rank + 1) % size;
+    left = (rank + size - 1) % size;
+
+/* Chunk c of the vector; the first n % size chunks are one longer. */
+#define CHUNK_START(c) \
+    (n / size * (c) + ((c) < n % size ? (c) : n % size))
+#define CHUNK_SIZE(c) (n / size + ((c) < n % size))
+
+    memcpy(rbuf, sbuf, n * sizeof(double));
+    for (s = 0; s < size - 1; ++s) {
+        int send = (rank - s + size) % size;
+        int recv = (rank - s - 1 + size) % size;
+
+        MPI_Sendrecv(rbuf + CHUNK_START(send), CHUNK_SIZE(send), MPI_DOUBLE,
+                     right, 2, tmp, CHUNK_SIZE(recv), MPI_DOUBLE, left, 2,
+                     comm, MPI_STATUS_IGNORE);
+        add(rbuf + CHUNK_START(recv), tmp, CHUNK_SIZE(recv));
+    }
+    /* Rank now holds the total of chunk rank+1. */
+    for (s = 0; s < size - 1; ++s) {
+        int send = (rank + 1 - s + size) % size;
+        int recv = (rank - s + size) % size;
+
+        MPI_Sendrecv(rbuf + CHUNK_START(send), CHUNK_SIZE(send), MPI_DOUBLE,
+                     right, 3, rbuf + CHUNK_START(recv), CHUNK_SIZE(recv),
+                     MPI_DOUBLE, left, 3, comm, MPI_STATUS_IGNORE);
+    }
+
+#undef CHUNK_START
+#undef CHUNK_SIZE
+}
+
+/*
+ * Rabenseifner: a reduce-scatter by recursive halving, then an allgather
+ * by recursive doubling.  log2(p) steps each, and about 2n doubles sent
+ * per rank, so good for long vectors at any rank count.
+ */
+static void allreduce_rabenseifner(const double *sbuf, double *rbuf,
+                                   double *tmp, int n, MPI_Comm comm)
+{
+    int lo[32], hi[32];
+    int rank, size, p2, rem, newrank, mask, level;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    for (p2 = 1; 2 * p2 <= size; p2 *= 2) {
+    }
+    rem = size - p2;
+
+    memcpy(rbuf, sbuf, n * sizeof(double));
+    newrank = fold(rbuf, tmp, n, rank, rem, comm);
+    if (newrank >= 0) {
+        /* Halve the range each step, keeping the half for this rank. */
+        int l = 0, h = n;
+
+        level = 0;
+        for (mask = p2 / 2; mask >= 1; mask /= 2) {
+            int partner = real_rank(newrank ^ mask, rem);
+            int mid = l + (h - l) / 2;
+            int keep_lo, keep_hi, give_lo, give_hi;
+
+            if (newrank & mask) {
+                keep_lo = mid; keep_hi = h; give_lo = l; give_hi = mid;
+            } else {
+                keep_lo = l; keep_hi = mid; give_lo = mid; give_hi = h;
+            }
+            MPI_Sendrecv(rbuf + give_lo, give_hi - give_lo, MPI_DOUBLE,
+                         partner, 4, tmp, keep_hi - keep_lo, MPI_DOUBLE,
+                         partner, 4, comm, MPI_STATUS_IGNORE);
+            add(rbuf + keep_lo, tmp, keep_hi - keep_lo);
+            lo[level] = l;
+            hi[level] = h;
+            level++;
+            l = keep_lo;
+            h = keep_hi;
+        }
+        /* Retrace the steps, swapping the reduced halves. */
+        for (mask = 1; mask < p2; mask *= 2) {
+            int partner = real_rank(newrank ^ mask, rem);
+            int mid, other_lo, other_hi;
+
+            level--;
+            mid = lo[level] + (hi[level] - lo[level]) / 2;
+            if (newrank & mask) {
+                other_lo = lo[level]; other_hi = mid;
+            } else {
+                other_lo = mid; other_hi = hi[level];
+            }
+            MPI_Sendrecv(rbuf + l, h - l, MPI_DOUBLE, partner, 5,
+                         rbuf + other_lo, other_hi - other_lo, MPI_DOUBLE,
+                         partner, 5, comm, MPI_STATUS_IGNORE);
+            l = lo[level];
+            h = hi[level];
+        }
+    }
+    unfold(rbuf, n, rank, rem, comm);
+}
+
+typedef void (*allreduce_fn)(const double *sbuf, double *rbuf, double *tmp,
+                             int n, MPI_Comm comm);
+
+static const struct {
+    const char *name;
+    allreduce_fn fn;
+} hand_written[] = {
+    { "ring", allreduce_ring },
+    { "rd", allreduce_rd },
+    { "rabenseifner", allreduce_rabenseifner },
+};
+
+#define NHAND ((int) (sizeof(hand_written) / sizeof(hand_written[0])))
+
+static const char *library_ops[] = {
+    "bcast", "reduce", "allreduce", "allgather"
+};
+
+#define NLIBRARY ((int) (sizeof(library_ops) / sizeof(library_ops[0])))
+
+/* True if OP is in the comma separated LIST, or LIST is "all". */
+static int selected(const char *list, const char *op)
+{
+    size_t len = strlen(op);
+    const char *p = list;
+
+    if (strcmp(list, "all") == 0) {
+        return 1;
+    }
+    while ((p = strstr(p, op)) != NULL) {
+        if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+            return 1;
+        }
+        p += len;
+    }
+    return 0;
+}
+
+/* Run operation OP (library op k, or hand-written op -1-k) once. */
+static void run_op(int op, double *sbuf, double *rbuf, double *tmp, int n,
+                   MPI_Comm comm)
+{
+    int size;
+
+    switch (op) {
+    case 0:
+        MPI_Bcast(sbuf, n, MPI_DOUBLE, 0, comm);
+        break;
+    case 1:
+        MPI_Reduce(sbuf, rbuf, n, MPI_DOUBLE, MPI_SUM, 0, comm);
+        break;
+    case 2:
+        MPI_Allreduce(sbuf, rbuf, n, MPI_DOUBLE, MPI_SUM, comm);
+        break;
+    case 3:
+        MPI_Comm_size(comm, &size);
+        MPI_Allgather(sbuf, n / size > 0 ? n / size : 1, MPI_DOUBLE,
+                      rbuf, n / size > 0 ? n / size : 1, MPI_DOUBLE, comm);
+        break;
+    default:
+        hand_written[-1 - op].fn(sbuf, rbuf, tmp, n, comm);
+        break;
+    }
+}
+
+/*
+ * Store the payload sizes in SIZES and return their number: MIN_BYTES
+ * doubled up to MAX_BYTES, with ENERGY_BYTES added in its place when it
+ * is in range but not on the sweep.
+ */
+static int payload_sizes(long min_bytes, long max_bytes, long *sizes)
+{
+    int extra = min_bytes <= ENERGY_BYTES && ENERGY_BYTES <= max_bytes;
+    int count = 0;
+    long bytes;
+
+    for (bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+        if (extra && bytes >= ENERGY_BYTES) {
+            if (bytes > ENERGY_BYTES) {
+                sizes[count++] = ENERGY_BYTES;
+            }
+            extra = 0;
+        }
+        sizes[count++] = bytes;
+    }
+    if (extra) {
+        sizes[count++] = ENERGY_BYTES;
+    }
+    return count;
+}
+
+/* Fill SBUF with small integers so that every summation order agrees. */
+static void fill(double *sbuf, int n, int rank)
+{
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        sbuf[i] = (rank + 1) * (i % 7 + 1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FILE *out = stdout;
+    const char *ops, *csv, *name;
+    long min_bytes, max_bytes, max_iters, bytes, iters, it;
+    long sizes[MAX_SIZES];
+    double *sbuf, *rbuf, *tmp, *check;
+    double t, t_min, t_max, t_sum;
+    int size, rank, k, op, n, bad, s, nsizes;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    ops = option_string(argc, argv, "ops", "COLL_OPS");
+    ops = ops == NULL ? "all" : ops;
+    min_bytes = option_long(argc, argv, "min", "COLL_MIN", 8);
+    max_bytes = option_long(argc, argv, "max", "COLL_MAX", 64L << 20);
+    max_iters = option_long(argc, argv, "iters", "COLL_ITERS", 1000);
+    csv = option_string(argc, argv, "csv", "COLL_CSV");
+    nsizes = payload_sizes(min_bytes, max_bytes, sizes);
+
+    n = max_bytes / sizeof(double) > 0 ? max_bytes / sizeof(double) : 1;
+    sbuf = malloc(n * sizeof(double));
+    rbuf = malloc((n + size) * sizeof(double));
+    tmp = malloc(n * sizeof(double));
+    check = malloc(n * sizeof(double));
+    if (sbuf == NULL || rbuf == NULL || tmp == NULL || check == NULL) {
+        fprintf(stderr, "Rank %d cannot allocate %ld byte buffers\n",
+                rank, max_bytes);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (rank == 0) {
+        if (csv != NULL && (out = fopen(csv, "w")) == NULL) {
+            fprintf(stderr, "Cannot open %s\n", csv);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fprintf(out, "op,ranks,bytes,iters,min_us,mean_us,max_us\n");
+    }
+
+    for (k = 0; k < NLIBRARY + NHAND; ++k) {
+        op = k < NLIBRARY ? k : NLIBRARY - 1 - k;
+        name = op < 0 ? hand_written[-1 - op].name : library_ops[op];
+        if (!selected(ops, name)) {
+            continue;
+        }
+        for (s = 0; s < nsizes; ++s) {
+            bytes = sizes[s];
+            n = bytes / sizeof(double) > 0 ? bytes / sizeof(double) : 1;
+            iters = BYTE_BUDGET / bytes;
+            iters = iters < MIN_ITERS ? MIN_ITERS : iters;
+            iters = iters > max_iters ? max_iters : iters;
+            fill(sbuf, n, rank);
+
+            if (op < 0) {
+                MPI_Allreduce(sbuf, check, n, MPI_DOUBLE, MPI_SUM,
+                              MPI_COMM_WORLD);
+                run_op(op, sbuf, rbuf, tmp, n, MPI_COMM_WORLD);
+                bad = memcmp(rbuf, check, n * sizeof(double)) != 0;
+                MPI_Allreduce(MPI_IN_PLACE, &bad, 1, MPI_INT, MPI_LOR,
+                              MPI_COMM_WORLD);
+                if (bad) {
+                    if (rank == 0) {
+                        fprintf(stderr, "%s gives a wrong sum for %d "
+                                "doubles\n", name, n);
+                    }
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            }
+
+            for (it = 0; it < iters / 10 + 1; ++it) {
+                run_op(op, sbuf, rbuf, tmp, n, MPI_COMM_WORLD);
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+            t = MPI_Wtime();
+            for (it = 0; it < iters; ++it) {
+                run_op(op, sbuf, rbuf, tmp, n, MPI_COMM_WORLD);
+            }
+            t = (MPI_Wtime() - t) / iters;
+
+            MPI_Reduce(&t, &t_min, 1, MPI_DOUBLE, MPI_MIN, 0,
+                       MPI_COMM_WORLD);
+            MPI_Reduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0,
+                       MPI_COMM_WORLD);
+            MPI_Reduce(&t, &t_sum, 1, MPI_DOUBLE, MPI_SUM, 0,
+                       MPI_COMM_WORLD);
+            if (rank == 0) {
+                fprintf(out, "%s,%d,%ld,%ld,%.3f,%.3f,%.3f\n", name, size,
+                        (long) (n * sizeof(double)), iters, 1e6 * t_min,
+                        1e6 * t_sum / size, 1e6 * t_max);
+                fflush(out);
+            }
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(check);
+    free(tmp);
+    free(rbuf);
+    free(sbuf);
+    MPI_Finalize();
+    return 0;
+}
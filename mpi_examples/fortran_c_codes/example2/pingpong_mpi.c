@@ -0,0 +1,435 @@
+/*
+ * Point-to-point latency and bandwidth, grown from example2_mpi.c.
+ *
+ *   mpicc -O3 -o pingpong_mpi pingpong_mpi.c
+ *   mpirun -np 2 ./pingpong_mpi [options]
+ *
+ * Options, as NAME=VALUE or in the environment as PINGPONG_<NAME>:
+ *
+ *   mode=blocking|nonblocking|persistent   Send/Recv, Isend/Irecv, or
+ *                                          Send_init/Recv_init + Start
+ *   pattern=pingpong|bidir|stream          one message each way in turn,
+ *                                          both ways at once, or a window
+ *                                          of messages one way then an ack
+ *   pairs=1        pairs exchanging at once: rank r talks to r + pairs
+ *   min=1 max=1073741824                   message sizes, doubling
+ *   iters=1000     timed iterations per size, fewer for large messages
+ *   window=64      messages per iteration for pattern=stream, fewer
+ *                  for large messages
+ *   csv=FILE       write the results there instead of to stdout
+ *
+ * For each size the CSV line gives latency percentiles over all
+ * iterations of all pairs (half the round trip for pingpong, the exchange
+ * time for bidir, the time per message for stream), in microseconds,
+ * and the aggregate bandwidth of all pairs in MB/s (10^6 bytes/s).
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+enum mode { BLOCKING, NONBLOCKING, PERSISTENT };
+enum pattern { PINGPONG, BIDIR, STREAM };
+
+/* Bytes moved per size before the iteration count is cut down. */
+#define BYTE_BUDGET (4L << 30)
+#define MIN_ITERS 10
+
+/*
+ * Return the value of option NAME, given on the command line as NAME=VALUE
+ * or in the environment variable ENV_NAME, or NULL if it is not set.
+ * The command line takes precedence.
+ */
+static const char *option_string(int argc, char **argv, const char *name,
+                                 const char *env_name)
+{
+    size_t len = strlen(name);
+    const char *value = NULL;
+    int k;
+
+    for (k = 1; k < argc; ++k) {
+        if (strncmp(argv[k], name, len) == 0 && argv[k][len] == '=') {
+            value = argv[k] + len + 1;
+        }
+    }
+    if (value == NULL) {
+        value = getenv(env_name);
+    }
+    if (value != NULL && *value == '\0') {
+        value = NULL;
+    }
+    return value;
+}
+
+/*
+ * Return the value of the integer option NAME (see option_string), or
+ * DEFAULT_VALUE if it is not set.
+ */
+static long option_long(int argc, char **argv, const char *name,
+                        const char *env_name, long default_value)
+{
+    const char *value = option_string(argc, argv, name, env_name);
+    char *end;
+    long result;
+
+    if (value == NULL) {
+        return default_value;
+    }
+    result = strtol(value, &end, 10);
+    if (*end != '\0' || result <= 0) {
+        fprintf(stderr, "Bad value for %s: %s\n", name, value);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return result;
+}
+
+/* Index of VALUE in the NULL-terminated list NAMES, or abort. */
+static int option_choice(int argc, char **argv, const char *name,
+                         const char *env_name, const char **names)
+{
+    const char *value = option_string(argc, argv, name, env_name);
+    int k;
+
+    if (value == NULL) {
+        return 0;
+    }
+    for (k = 0; names[k] != NULL; ++k) {
+        if (strcmp(value, names[k]) == 0) {
+            return k;
+        }
+    }
+    fprintf(stderr, "Bad value for %s: %s\n", name, value);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+    return 0;
+}
+
+typedef struct {
+    enum mode mode;
+    enum pattern pattern;
+    int partner;
+    int initiator;              /* sends first; measures */
+    int window;
+    long bytes;
+    char *sbuf, *rbuf;
+    MPI_Request *requests;      /* window + 1 */
+} exchange;
+
+/*
+ * Create the persistent requests for one size.  For stream the initiator
+ * sends a window of messages and receives a one byte ack, and the other
+ * rank does the reverse; nonblocking mode posts the same requests with
+ * post() each iteration.  All stream messages land in the same receive
+ * buffer, as in the usual bandwidth benchmarks.
+ */
+static void init_persistent(exchange *x)
+{
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int w;
+
+    switch (x->pattern) {
+    case PINGPONG:
+    case BIDIR:
+        MPI_Send_init(x->sbuf, x->bytes, MPI_BYTE, x->partner, 0, comm,
+                      &x->requests[0]);
+        MPI_Recv_init(x->rbuf, x->bytes, MPI_BYTE, x->partner, 0, comm,
+                      &x->requests[1]);
+        break;
+    case STREAM:
+        for (w = 0; w < x->window; ++w) {
+            if (x->initiator) {
+                MPI_Send_init(x->sbuf, x->bytes, MPI_BYTE, x->partner, 0,
+                              comm, &x->requests[w]);
+            } else {
+                MPI_Recv_init(x->rbuf, x->bytes, MPI_BYTE, x->partner, 0,
+                              comm, &x->requests[w]);
+            }
+        }
+        if (x->initiator) {
+            MPI_Recv_init(x->rbuf, 1, MPI_BYTE, x->partner, 1, comm,
+                          &x->requests[x->window]);
+        } else {
+            MPI_Send_init(x->sbuf, 1, MPI_BYTE, x->partner, 1, comm,
+                          &x->requests[x->window]);
+        }
+        break;
+    }
+}
+
+static void free_persistent(exchange *x)
+{
+    int n = x->pattern == STREAM ? x->window + 1 : 2;
+    int k;
+
+    for (k = 0; k < n; ++k) {
+        MPI_Request_free(&x->requests[k]);
+    }
+}
+
+/* Send (SEND true) or receive one message of COUNT bytes, request K. */
+static void post(exchange *x, int send, int count, int tag, int k)
+{
+    MPI_Comm comm = MPI_COMM_WORLD;
+
+    if (x->mode == PERSISTENT) {
+        MPI_Start(&x->requests[k]);
+    } else if (send) {
+        MPI_Isend(x->sbuf, count, MPI_BYTE, x->partner, tag, comm,
+                  &x->requests[k]);
+    } else {
+        MPI_Irecv(x->rbuf, count, MPI_BYTE, x->partner, tag, comm,
+                  &x->requests[k]);
+    }
+}
+
+/* One iteration of the pattern. */
+static void iterate(exchange *x)
+{
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int w;
+
+    if (x->mode == BLOCKING) {
+        switch (x->pattern) {
+        case PINGPONG:
+            if (x->initiator) {
+                MPI_Send(x->sbuf, x->bytes, MPI_BYTE, x->partner, 0, comm);
+                MPI_Recv(x->rbuf, x->bytes, MPI_BYTE, x->partner, 0, comm,
+                         MPI_STATUS_IGNORE);
+            } else {
+                MPI_Recv(x->rbuf, x->bytes, MPI_BYTE, x->partner, 0, comm,
+                         MPI_STATUS_IGNORE);
+                MPI_Send(x->sbuf, x->bytes, MPI_BYTE, x->partner, 0, comm);
+            }
+            break;
+        case BIDIR:
+            MPI_Sendrecv(x->sbuf, x->bytes, MPI_BYTE, x->partner, 0,
+                         x->rbuf, x->bytes, MPI_BYTE, x->partner, 0, comm,
+                         MPI_STATUS_IGNORE);
+            break;
+        case STREAM:
+            for (w = 0; w < x->window; ++w) {
+                if (x->initiator) {
+                    MPI_Send(x->sbuf, x->bytes, MPI_BYTE, x->partner, 0,
+                             comm);
+                } else {
+                    MPI_Recv(x->rbuf, x->bytes, MPI_BYTE, x->partner, 0,
+                             comm, MPI_STATUS_IGNORE);
+                }
+            }
+            if (x->initiator) {
+                MPI_Recv(x->rbuf, 1, MPI_BYTE, x->partner, 1, comm,
+                         MPI_STATUS_IGNORE);
+            } else {
+                MPI_Send(x->sbuf, 1, MPI_BYTE, x->partner, 1, comm);
+            }
+            break;
+        }
+        return;
+    }
+
+    /* Nonblocking and persistent: the receive is always posted first. */
+    switch (x->pattern) {
+    case PINGPONG:
+        if (x->initiator) {
+            post(x, 0, x->bytes, 0, 1);
+            post(x, 1, x->bytes, 0, 0);
+            MPI_Waitall(2, x->requests, MPI_STATUSES_IGNORE);
+        } else {
+            post(x, 0, x->bytes, 0, 1);
+            MPI_Wait(&x->requests[1], MPI_STATUS_IGNORE);
+            post(x, 1, x->bytes, 0, 0);
+            MPI_Wait(&x->requests[0], MPI_STATUS_IGNORE);
+        }
+        break;
+    case BIDIR:
+        post(x, 0, x->bytes, 0, 1);
+        post(x, 1, x->bytes, 0, 0);
+        MPI_Waitall(2, x->requests, MPI_STATUSES_IGNORE);
+        break;
+    case STREAM:
+        if (x->initiator) {
+            post(x, 0, 1, 1, x->window);
+        }
+        for (w = 0; w < x->window; ++w) {
+            post(x, x->initiator, x->bytes, 0, w);
+        }
+        MPI_Waitall(x->window, x->requests, MPI_STATUSES_IGNORE);
+        if (x->initiator) {
+            MPI_Wait(&x->requests[x->window], MPI_STATUS_IGNORE);
+        } else {
+            post(x, 1, 1, 1, x->window);
+            MPI_Wait(&x->requests[x->window], MPI_STATUS_IGNORE);
+        }
+        break;
+    }
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* The Q quantile of the N sorted values V. */
+static double percentile(const double *v, long n, double q)
+{
+    return v[(long) (q * (n - 1) + 0.5)];
+}
+
+int main(int argc, char **argv)
+{
+    static const char *mode_names[] = {
+        "blocking", "nonblocking", "persistent", NULL
+    };
+    static const char *pattern_names[] = {
+        "pingpong", "bidir", "stream", NULL
+    };
+    exchange x;
+    FILE *out = stdout;
+    const char *csv;
+    long min_bytes, max_bytes, max_iters, max_window, iters, warmup, it;
+    double *samples, *all = NULL, t, elapsed, longest;
+    int *counts = NULL, *displs = NULL;
+    int np, rank, pairs, active, r;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &np);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    x.mode = option_choice(argc, argv, "mode", "PINGPONG_MODE", mode_names);
+    x.pattern = option_choice(argc, argv, "pattern", "PINGPONG_PATTERN",
+                              pattern_names);
+    pairs = option_long(argc, argv, "pairs", "PINGPONG_PAIRS", 1);
+    min_bytes = option_long(argc, argv, "min", "PINGPONG_MIN", 1);
+    max_bytes = option_long(argc, argv, "max", "PINGPONG_MAX", 1L << 30);
+    max_iters = option_long(argc, argv, "iters", "PINGPONG_ITERS", 1000);
+    max_window = option_long(argc, argv, "window", "PINGPONG_WINDOW", 64);
+    csv = option_string(argc, argv, "csv", "PINGPONG_CSV");
+
+    if (np < 2 * pairs) {
+        if (rank == 0) {
+            fprintf(stderr, "%d pairs need at least %d ranks\n",
+                    pairs, 2 * pairs);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    active = rank < 2 * pairs;
+    x.initiator = rank < pairs;
+    x.partner = x.initiator ? rank + pairs : rank - pairs;
+
+    x.sbuf = malloc(max_bytes);
+    x.rbuf = malloc(max_bytes);
+    x.requests = malloc((max_window + 1) * sizeof(MPI_Request));
+    samples = malloc(max_iters * sizeof(double));
+    if (rank == 0) {
+        all = malloc(max_iters * pairs * sizeof(double));
+        counts = malloc(np * sizeof(int));
+        displs = malloc(np * sizeof(int));
+    }
+    if (x.sbuf == NULL || x.rbuf == NULL || x.requests == NULL
+        || samples == NULL
+        || (rank == 0 && (all == NULL || counts == NULL || displs == NULL))) {
+        fprintf(stderr, "Rank %d cannot allocate %ld byte buffers\n",
+                rank, max_bytes);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    memset(x.sbuf, rank, max_bytes);
+    memset(x.rbuf, 0, max_bytes);
+
+    if (rank == 0) {
+        if (csv != NULL && (out = fopen(csv, "w")) == NULL) {
+            fprintf(stderr, "Cannot open %s\n", csv);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fprintf(out, "mode,pattern,pairs,bytes,iters,lat_min_us,lat_p50_us,"
+                "lat_p90_us,lat_p99_us,lat_max_us,bw_MBps\n");
+    }
+
+    for (x.bytes = min_bytes; x.bytes <= max_bytes; x.bytes *= 2) {
+        long per_iter, n;
+
+        /*
+         * A stream window is cut down first, so that even MIN_ITERS
+         * iterations of the largest messages stay near the budget.
+         */
+        x.window = max_window;
+        if (x.pattern == STREAM && x.window * x.bytes * MIN_ITERS
+            > BYTE_BUDGET) {
+            x.window = BYTE_BUDGET / (x.bytes * MIN_ITERS);
+            x.window = x.window < 1 ? 1 : x.window;
+        }
+        per_iter = x.bytes * (x.pattern == STREAM ? x.window : 2);
+        iters = BYTE_BUDGET / per_iter;
+        iters = iters < MIN_ITERS ? MIN_ITERS : iters;
+        iters = iters > max_iters ? max_iters : iters;
+        warmup = iters / 10 + 1;
+
+        if (active && x.mode == PERSISTENT) {
+            init_persistent(&x);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        elapsed = 0.0;
+        if (active) {
+            for (it = 0; it < warmup; ++it) {
+                iterate(&x);
+            }
+            for (it = 0; it < iters; ++it) {
+                t = MPI_Wtime();
+                iterate(&x);
+                samples[it] = MPI_Wtime() - t;
+                elapsed += samples[it];
+            }
+            if (x.mode == PERSISTENT) {
+                free_persistent(&x);
+            }
+        }
+
+        /*
+         * The initiators, ranks 0 .. pairs-1, measure the latencies, and
+         * only they send samples.
+         */
+        for (it = 0; x.initiator && it < iters; ++it) {
+            if (x.pattern == PINGPONG) {
+                samples[it] /= 2;
+            } else if (x.pattern == STREAM) {
+                samples[it] /= x.window;
+            }
+        }
+        if (rank == 0) {
+            for (r = 0; r < np; ++r) {
+                counts[r] = r < pairs ? iters : 0;
+                displs[r] = r < pairs ? r * iters : 0;
+            }
+        }
+        MPI_Gatherv(samples, x.initiator ? iters : 0, MPI_DOUBLE, all,
+                    counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&elapsed, &longest, 1, MPI_DOUBLE, MPI_MAX, 0,
+                   MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            n = iters * pairs;
+            qsort(all, n, sizeof(double), compare_double);
+            fprintf(out, "%s,%s,%d,%ld,%ld,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f\n",
+                    mode_names[x.mode], pattern_names[x.pattern], pairs,
+                    x.bytes, iters, 1e6 * all[0],
+                    1e6 * percentile(all, n, 0.50),
+                    1e6 * percentile(all, n, 0.90),
+                    1e6 * percentile(all, n, 0.99), 1e6 * all[n - 1],
+                    (double) per_iter * iters * pairs / longest / 1e6);
+            fflush(out);
+        }
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(displs);
+    free(counts);
+    free(all);
+    free(samples);
+    free(x.requests);
+    free(x.rbuf);
+    free(x.sbuf);
+    MPI_Finalize();
+    return 0;
+}
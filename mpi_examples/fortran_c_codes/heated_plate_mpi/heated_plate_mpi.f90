@@ -0,0 +1,697 @@
+program main
+
+!*****************************************************************************80
+!
+!! MAIN is the main program for HEATED_PLATE_MPI.
+!
+!  Discussion:
+!
+!    This code solves the steady state heat equation on a rectangular region,
+!    using the same grid, boundary conditions and Jacobi iteration as
+!    HEATED_PLATE_OPENMP, but distributing the plate over MPI processes,
+!    each of which may use several OpenMP threads.
+!
+!    The processes are arranged in a 2D Cartesian grid, created by
+!    MPI_CART_CREATE, and each one owns a rectangular block of the M by N
+!    nodes, stored with one extra layer of "halo" nodes around it:
+!
+!      U(I_LO-1:I_HI+1,J_LO-1:J_HI+1)
+!
+!    Arrays are indexed by the global node indices, so the update formula
+!    is the same as in the OpenMP code.
+!
+!    At each iteration, a process sends the edges of its block to its four
+!    neighbors, and receives their edges into its halo, with nonblocking
+!    MPI_ISEND and MPI_IRECV.  While the messages are in flight, it updates
+!    the nodes that do not need the halo.  Then it waits, and updates the
+!    edges of its block.
+!
+!    The new and old solutions are kept in two arrays whose roles swap at
+!    every iteration, and the change DIFF is computed during the update.
+!    The global DIFF is the MPI_ALLREDUCE maximum of the local values.
+!
+!    Since each node is computed by the same formula as in the OpenMP code,
+!    the iterates, and the number of iterations, do not depend on the
+!    number of processes or threads.
+!
+!    The grid size and tolerance are read by process 0 from the command
+!    line, or from the environment variables PLATE_M, PLATE_N and PLATE_EPS,
+!    and broadcast.  Usage:
+!
+!      mpirun -np 16 ./heated_plate_mpi m=20000 n=20000 eps=0.001
+!
+!    At the end, one line beginning with "SCALING" summarizes the run, so
+!    that the output of strong scaling runs (fixed M and N) and weak
+!    scaling runs (M*N proportional to the number of processes) can be
+!    collected with grep.
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license.
+!
+!  Author:
+!
+!    Based on HEATED_PLATE_OPENMP, by Michael Quinn and John Burkardt.
+!
+!  Local parameters:
+!
+!    Local, real ( kind = 8 ) DIFF, the norm of the change in the solution from
+!    one iteration to the next.
+!
+!    Local, real ( kind = 8 ) MEAN, the average of the boundary values, used
+!    to initialize the values of the solution in the interior.
+!
+!    Local, real ( kind = 8 ) U(I_LO-1:I_HI+1,J_LO-1:J_HI+1),
+!    W(I_LO-1:I_HI+1,J_LO-1:J_HI+1), the local blocks of the solution at
+!    the previous and latest iterations.
+!
+  use mpi
+  use omp_lib
+
+  implicit none
+
+  integer ( kind = 4 ) comm_cart
+  integer ( kind = 4 ) coords(2)
+  real ( kind = 8 ) diff
+  real ( kind = 8 ) diff_local
+  integer ( kind = 4 ) dims(2)
+  real ( kind = 8 ) :: eps = 0.001D+00
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) i_hi
+  integer ( kind = 4 ) i_lo
+  integer ( kind = 4 ) ierr
+  integer ( kind = 4 ) iterations
+  integer ( kind = 4 ) iterations_print
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) j_hi
+  integer ( kind = 4 ) j_lo
+  integer ( kind = 4 ) :: m = 600
+  real ( kind = 8 ) mean
+  real ( kind = 8 ) mean_local
+  integer ( kind = 4 ) my_id
+  integer ( kind = 4 ) :: n = 600
+  integer ( kind = 4 ) nbr_down
+  integer ( kind = 4 ) nbr_left
+  integer ( kind = 4 ) nbr_right
+  integer ( kind = 4 ) nbr_up
+  integer ( kind = 4 ) num_procs
+  integer ( kind = 4 ) params(2)
+  logical periods(2)
+  integer ( kind = 4 ) provided
+  integer ( kind = 4 ) row_type
+  real ( kind = 8 ), allocatable :: u(:,:)
+  real ( kind = 8 ), allocatable :: w(:,:)
+  real ( kind = 8 ) wtime
+
+  call MPI_INIT_THREAD ( MPI_THREAD_FUNNELED, provided, ierr )
+  call MPI_COMM_SIZE ( MPI_COMM_WORLD, num_procs, ierr )
+  call MPI_COMM_RANK ( MPI_COMM_WORLD, my_id, ierr )
+!
+!  The master thread waits for the halo messages inside a parallel region.
+!
+  if ( provided < MPI_THREAD_FUNNELED ) then
+    if ( my_id == 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'HEATED_PLATE_MPI - Fatal error!'
+      write ( *, '(a)' ) '  MPI does not provide MPI_THREAD_FUNNELED.'
+    end if
+    call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+  end if
+!
+!  Process 0 reads the problem size and tolerance, and broadcasts them.
+!
+  if ( my_id == 0 ) then
+    call option_get_i4 ( 'm', 'PLATE_M', m )
+    call option_get_i4 ( 'n', 'PLATE_N', n )
+    call option_get_r8 ( 'eps', 'PLATE_EPS', eps )
+    params(1) = m
+    params(2) = n
+  end if
+
+  call MPI_BCAST ( params, 2, MPI_INTEGER, 0, MPI_COMM_WORLD, ierr )
+  call MPI_BCAST ( eps, 1, MPI_DOUBLE_PRECISION, 0, MPI_COMM_WORLD, ierr )
+  m = params(1)
+  n = params(2)
+
+  if ( m < 3 .or. n < 3 ) then
+    if ( my_id == 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'HEATED_PLATE_MPI - Fatal error!'
+      write ( *, '(a)' ) '  M and N must be at least 3.'
+    end if
+    call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+  end if
+!
+!  Arrange the processes in a 2D grid, and find my block and my neighbors.
+!  Dimension 1 runs along I, and dimension 2 along J.
+!
+  dims(1:2) = 0
+  call MPI_DIMS_CREATE ( num_procs, 2, dims, ierr )
+  periods(1:2) = .false.
+  call MPI_CART_CREATE ( MPI_COMM_WORLD, 2, dims, periods, .true., &
+    comm_cart, ierr )
+  call MPI_COMM_RANK ( comm_cart, my_id, ierr )
+  call MPI_CART_COORDS ( comm_cart, my_id, 2, coords, ierr )
+  call MPI_CART_SHIFT ( comm_cart, 0, 1, nbr_up, nbr_down, ierr )
+  call MPI_CART_SHIFT ( comm_cart, 1, 1, nbr_left, nbr_right, ierr )
+
+  call block_range ( m, dims(1), coords(1), i_lo, i_hi )
+  call block_range ( n, dims(2), coords(2), j_lo, j_hi )
+
+  if ( i_hi < i_lo .or. j_hi < j_lo ) then
+    if ( my_id == 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'HEATED_PLATE_MPI - Fatal error!'
+      write ( *, '(a)' ) '  Too many processes for the grid.'
+    end if
+    call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+  end if
+!
+!  A row of the block is strided in memory.
+!
+  call MPI_TYPE_VECTOR ( j_hi - j_lo + 1, 1, i_hi - i_lo + 3, &
+    MPI_DOUBLE_PRECISION, row_type, ierr )
+  call MPI_TYPE_COMMIT ( row_type, ierr )
+
+  allocate ( u(i_lo-1:i_hi+1,j_lo-1:j_hi+1) )
+  allocate ( w(i_lo-1:i_hi+1,j_lo-1:j_hi+1) )
+
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'HEATED_PLATE_MPI'
+    write ( *, '(a)' ) '  FORTRAN90/MPI/OpenMP version'
+    write ( *, '(a)' ) &
+      '  A program to solve for the steady state temperature distribution'
+    write ( *, '(a)' ) '  over a rectangular plate.'
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,i8,a,i8,a)' ) '  Spatial grid of ', m, ' by ', n, ' points.'
+    write ( *, '(a,g14.6)' ) &
+      '  The iteration will repeat until the change is <= ', eps
+    write ( *, '(a,i8,a,i8,a)' ) &
+      '  The processes form a ', dims(1), ' by ', dims(2), ' grid.'
+    write ( *, '(a,i8)' ) &
+      '  The number of threads per process  = ', omp_get_max_threads ( )
+  end if
+!
+!  Set the boundary values, which don't change, in both arrays, and the
+!  halo to zero.
+!
+  mean_local = 0.0D+00
+
+!$omp parallel shared ( u, w ) private ( i, j )
+
+  !$omp do schedule ( static )
+  do j = j_lo - 1, j_hi + 1
+    do i = i_lo - 1, i_hi + 1
+      w(i,j) = 0.0D+00
+    end do
+  end do
+  !$omp end do
+
+!$omp end parallel
+
+  do i = max ( 2, i_lo ), min ( m - 1, i_hi )
+    if ( j_lo == 1 ) then
+      w(i,1) = 100.0D+00
+      mean_local = mean_local + w(i,1)
+    end if
+    if ( j_hi == n ) then
+      w(i,n) = 100.0D+00
+      mean_local = mean_local + w(i,n)
+    end if
+  end do
+
+  do j = j_lo, j_hi
+    if ( i_hi == m ) then
+      w(m,j) = 100.0D+00
+      mean_local = mean_local + w(m,j)
+    end if
+    if ( i_lo == 1 ) then
+      w(1,j) = 0.0D+00
+      mean_local = mean_local + w(1,j)
+    end if
+  end do
+!
+!  Average the boundary values, to come up with a reasonable
+!  initial value for the interior.
+!
+  call MPI_ALLREDUCE ( mean_local, mean, 1, MPI_DOUBLE_PRECISION, MPI_SUM, &
+    comm_cart, ierr )
+  mean = mean / dble ( 2 * m + 2 * n - 4 )
+
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,g14.6)' ) '  MEAN = ', mean
+  end if
+!
+!  Initialize the interior solution to the mean value.
+!
+!$omp parallel shared ( mean, u, w ) private ( i, j )
+
+  !$omp do schedule ( static )
+  do j = max ( 2, j_lo ), min ( n - 1, j_hi )
+    do i = max ( 2, i_lo ), min ( m - 1, i_hi )
+      w(i,j) = mean
+    end do
+  end do
+  !$omp end do
+
+  !$omp do schedule ( static )
+  do j = j_lo - 1, j_hi + 1
+    do i = i_lo - 1, i_hi + 1
+      u(i,j) = w(i,j)
+    end do
+  end do
+  !$omp end do
+
+!$omp end parallel
+!
+!  Iterate until the new solution differs from the old solution
+!  by no more than EPS.  Odd iterations compute U from W, and even
+!  iterations compute W from U.
+!
+  iterations = 0
+  iterations_print = 1
+
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) ' Iteration  Change'
+    write ( *, '(a)' ) ' '
+  end if
+
+  call MPI_BARRIER ( comm_cart, ierr )
+  wtime = MPI_WTIME ( )
+
+  diff = eps
+
+  do while ( eps <= diff )
+
+    if ( mod ( iterations, 2 ) == 0 ) then
+      call plate_iterate ( m, n, i_lo, i_hi, j_lo, j_hi, w, u, comm_cart, &
+        row_type, nbr_up, nbr_down, nbr_left, nbr_right, diff_local )
+    else
+      call plate_iterate ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, comm_cart, &
+        row_type, nbr_up, nbr_down, nbr_left, nbr_right, diff_local )
+    end if
+
+    call MPI_ALLREDUCE ( diff_local, diff, 1, MPI_DOUBLE_PRECISION, &
+      MPI_MAX, comm_cart, ierr )
+
+    iterations = iterations + 1
+
+    if ( my_id == 0 .and. iterations == iterations_print ) then
+      write ( *, '(2x,i8,2x,g14.6)' ) iterations, diff
+      iterations_print = 2 * iterations_print
+    end if
+
+  end do
+
+  wtime = MPI_WTIME ( ) - wtime
+!
+!  The latest solution is in U after an odd number of iterations.
+!
+  if ( mod ( iterations, 2 ) == 1 ) then
+    w(i_lo:i_hi,j_lo:j_hi) = u(i_lo:i_hi,j_lo:j_hi)
+  end if
+
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(2x,i8,2x,g14.6)' ) iterations, diff
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) '  Error tolerance achieved.'
+    write ( *, '(a,g14.6)' ) '  Wall clock time = ', wtime
+    write ( *, '(a,g14.6)' ) '  Node updates per second = ', &
+      dble ( m - 2 ) * dble ( n - 2 ) * dble ( iterations ) / wtime
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,2(1x,i6),2(1x,i8),1x,i10,1x,g14.6)' ) &
+      'SCALING ranks threads m n iterations seconds', &
+      num_procs, omp_get_max_threads ( ), m, n, iterations, wtime
+  end if
+
+  deallocate ( u )
+  deallocate ( w )
+  call MPI_TYPE_FREE ( row_type, ierr )
+  call MPI_COMM_FREE ( comm_cart, ierr )
+!
+!  Terminate.
+!
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'HEATED_PLATE_MPI:'
+    write ( *, '(a)' ) '  Normal end of execution.'
+  end if
+
+  call MPI_FINALIZE ( ierr )
+
+  stop
+end
+subroutine block_range ( n, p, k, lo, hi )
+
+!*****************************************************************************80
+!
+!! BLOCK_RANGE returns the indices of the K-th of P blocks of 1:N.
+!
+!  Discussion:
+!
+!    The first mod(N,P) blocks get one index more than the others.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) N, the number of indices.
+!
+!    Input, integer ( kind = 4 ) P, the number of blocks.
+!
+!    Input, integer ( kind = 4 ) K, the block, between 0 and P-1.
+!
+!    Output, integer ( kind = 4 ) LO, HI, the first and last index of the
+!    block.
+!
+  implicit none
+
+  integer ( kind = 4 ) hi
+  integer ( kind = 4 ) k
+  integer ( kind = 4 ) lo
+  integer ( kind = 4 ) n
+  integer ( kind = 4 ) p
+
+  lo = k * ( n / p ) + min ( k, mod ( n, p ) ) + 1
+  hi = lo + n / p - 1
+  if ( k < mod ( n, p ) ) then
+    hi = hi + 1
+  end if
+
+  return
+end
+subroutine option_get ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET returns the value of a run time option.
+!
+!  Discussion:
+!
+!    The option NAME may be given on the command line as NAME=VALUE, or
+!    in the environment variable ENV_NAME.  The command line takes
+!    precedence.  If the option is not given, VALUE is unchanged.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, character ( len = * ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = 255 ) arg
+  character ( len = * ) env_name
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) k
+  integer ( kind = 4 ) length
+  character ( len = * ) name
+  integer ( kind = 4 ) status
+  character ( len = * ) value
+
+  do i = 1, command_argument_count ( )
+    call get_command_argument ( i, arg )
+    k = index ( arg, '=' )
+    if ( 1 < k ) then
+      if ( arg(1:k-1) == name ) then
+        value = arg(k+1:)
+        return
+      end if
+    end if
+  end do
+
+  call get_environment_variable ( env_name, arg, length, status )
+  if ( status == 0 .and. 0 < length ) then
+    value = arg
+  end if
+
+  return
+end
+subroutine option_get_i4 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_I4 returns the value of an integer run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, integer ( kind = 4 ) VALUE, the value of the option.
+!
+  use mpi
+
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ierr
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  integer ( kind = 4 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_I4 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+    end if
+  end if
+
+  return
+end
+subroutine option_get_r8 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_R8 returns the value of a real run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, real ( kind = 8 ) VALUE, the value of the option.
+!
+  use mpi
+
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ierr
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  real ( kind = 8 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_R8 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+    end if
+  end if
+
+  return
+end
+subroutine plate_iterate ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, comm, &
+  row_type, nbr_up, nbr_down, nbr_left, nbr_right, diff )
+
+!*****************************************************************************80
+!
+!! PLATE_ITERATE carries out one Jacobi iteration on the local block.
+!
+!  Discussion:
+!
+!    The halo of U is filled from the neighbors while the nodes that do
+!    not depend on it are updated.  The four edges of the block are
+!    updated once the messages have arrived.
+!
+!    The threads share one parallel region for all five updates.  Only
+!    the master thread waits for the messages, as MPI_THREAD_FUNNELED
+!    requires, and the others wait for it at a barrier.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the global grid.
+!
+!    Input, integer ( kind = 4 ) I_LO, I_HI, J_LO, J_HI, the global indices
+!    of the local block.
+!
+!    Input/output, real ( kind = 8 ) U(I_LO-1:I_HI+1,J_LO-1:J_HI+1), the
+!    solution at the previous iteration.  On output, the halo has been
+!    filled in.
+!
+!    Output, real ( kind = 8 ) W(I_LO-1:I_HI+1,J_LO-1:J_HI+1), the solution
+!    at the new iteration.
+!
+!    Input, integer ( kind = 4 ) COMM, the Cartesian communicator.
+!
+!    Input, integer ( kind = 4 ) ROW_TYPE, an MPI datatype for one row of
+!    the block.
+!
+!    Input, integer ( kind = 4 ) NBR_UP, NBR_DOWN, NBR_LEFT, NBR_RIGHT, the
+!    neighbors at smaller and larger I and J, or MPI_PROC_NULL.
+!
+!    Output, real ( kind = 8 ) DIFF, the largest change in the local block.
+!
+  use mpi
+
+  implicit none
+
+  integer ( kind = 4 ) i_hi
+  integer ( kind = 4 ) i_lo
+  integer ( kind = 4 ) j_hi
+  integer ( kind = 4 ) j_lo
+
+  integer ( kind = 4 ) comm
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) ierr
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+  integer ( kind = 4 ) nbr_down
+  integer ( kind = 4 ) nbr_left
+  integer ( kind = 4 ) nbr_right
+  integer ( kind = 4 ) nbr_up
+  integer ( kind = 4 ) nrow
+  integer ( kind = 4 ) requests(8)
+  integer ( kind = 4 ) row_type
+  real ( kind = 8 ) u(i_lo-1:i_hi+1,j_lo-1:j_hi+1)
+  real ( kind = 8 ) w(i_lo-1:i_hi+1,j_lo-1:j_hi+1)
+
+  nrow = i_hi - i_lo + 1
+!
+!  Columns are contiguous, and rows are described by ROW_TYPE.  The corner
+!  halo nodes are not needed.
+!
+  call MPI_IRECV ( u(i_lo,j_lo-1), nrow, MPI_DOUBLE_PRECISION, nbr_left, &
+    1, comm, requests(1), ierr )
+  call MPI_IRECV ( u(i_lo,j_hi+1), nrow, MPI_DOUBLE_PRECISION, nbr_right, &
+    2, comm, requests(2), ierr )
+  call MPI_IRECV ( u(i_lo-1,j_lo), 1, row_type, nbr_up, &
+    3, comm, requests(3), ierr )
+  call MPI_IRECV ( u(i_hi+1,j_lo), 1, row_type, nbr_down, &
+    4, comm, requests(4), ierr )
+
+  call MPI_ISEND ( u(i_lo,j_hi), nrow, MPI_DOUBLE_PRECISION, nbr_right, &
+    1, comm, requests(5), ierr )
+  call MPI_ISEND ( u(i_lo,j_lo), nrow, MPI_DOUBLE_PRECISION, nbr_left, &
+    2, comm, requests(6), ierr )
+  call MPI_ISEND ( u(i_hi,j_lo), 1, row_type, nbr_down, &
+    3, comm, requests(7), ierr )
+  call MPI_ISEND ( u(i_lo,j_lo), 1, row_type, nbr_up, &
+    4, comm, requests(8), ierr )
+
+  diff = 0.0D+00
+
+!$omp parallel shared ( diff, requests, u, w ) private ( ierr )
+!
+!  The inside of the block does not need the halo.
+!
+  call plate_update ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, &
+    i_lo + 1, i_hi - 1, j_lo + 1, j_hi - 1, diff )
+
+  !$omp master
+  call MPI_WAITALL ( 8, requests, MPI_STATUSES_IGNORE, ierr )
+  !$omp end master
+
+  !$omp barrier
+!
+!  The edges do.
+!
+  call plate_update ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, &
+    i_lo, i_lo, j_lo, j_hi, diff )
+  if ( i_lo < i_hi ) then
+    call plate_update ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, &
+      i_hi, i_hi, j_lo, j_hi, diff )
+  end if
+  call plate_update ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, &
+    i_lo + 1, i_hi - 1, j_lo, j_lo, diff )
+  if ( j_lo < j_hi ) then
+    call plate_update ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, &
+      i_lo + 1, i_hi - 1, j_hi, j_hi, diff )
+  end if
+
+!$omp end parallel
+
+  return
+end
+subroutine plate_update ( m, n, i_lo, i_hi, j_lo, j_hi, u, w, &
+  i1, i2, j1, j2, diff )
+
+!*****************************************************************************80
+!
+!! PLATE_UPDATE applies the Jacobi update to a rectangle of the local block.
+!
+!  Discussion:
+!
+!    Only the nodes of the rectangle I1:I2, J1:J2 that are in the interior
+!    of the global grid are updated; the boundary nodes keep their values.
+!
+!    It is called by every thread of a parallel region, which shares the
+!    loop, and DIFF must be shared there.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the global grid.
+!
+!    Input, integer ( kind = 4 ) I_LO, I_HI, J_LO, J_HI, the global indices
+!    of the local block.
+!
+!    Input, real ( kind = 8 ) U(I_LO-1:I_HI+1,J_LO-1:J_HI+1), the solution
+!    at the previous iteration.
+!
+!    Input/output, real ( kind = 8 ) W(I_LO-1:I_HI+1,J_LO-1:J_HI+1), the
+!    solution at the new iteration.
+!
+!    Input, integer ( kind = 4 ) I1, I2, J1, J2, the rectangle to update.
+!
+!    Input/output, real ( kind = 8 ) DIFF, the largest change so far.
+!
+  implicit none
+
+  integer ( kind = 4 ) i_hi
+  integer ( kind = 4 ) i_lo
+  integer ( kind = 4 ) j_hi
+  integer ( kind = 4 ) j_lo
+
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) i1
+  integer ( kind = 4 ) i2
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) j1
+  integer ( kind = 4 ) j2
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+  real ( kind = 8 ) u(i_lo-1:i_hi+1,j_lo-1:j_hi+1)
+  real ( kind = 8 ) w(i_lo-1:i_hi+1,j_lo-1:j_hi+1)
+
+  !$omp do schedule ( static ) reduction ( max : diff )
+  do j = max ( 2, j1 ), min ( n - 1, j2 )
+    do i = max ( 2, i1 ), min ( m - 1, i2 )
+      w(i,j) = 0.25D+00 * ( u(i-1,j) + u(i+1,j) + u(i,j-1) + u(i,j+1) )
+      diff = max ( diff, abs ( u(i,j) - w(i,j) ) )
+    end do
+  end do
+  !$omp end do
+
+  return
+end
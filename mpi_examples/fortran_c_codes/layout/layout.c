@@ -1,13 +1,300 @@
+/*
+ * Where do the ranks and threads run?  For every MPI rank and OpenMP
+ * thread, print the CPU it is on, that CPU's core, socket and NUMA node,
+ * and the CPUs it may run on; show which ranks share a node (the
+ * MPI_Comm_split_type shared memory groups); and warn about
+ * oversubscription, threads sharing a CPU, unbound threads and ranks
+ * spread over several sockets.
+ *
+ *   mpicc -O2 -fopenmp -o layout layout.c
+ *   OMP_NUM_THREADS=4 OMP_PLACES=cores OMP_PROC_BIND=close \
+ *       mpirun -np 2 --bind-to socket ./layout
+ *
+ * Topology comes from /sys/devices/system/cpu, so this is Linux only.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <omp.h>
 #include <mpi.h>
 
-int main (int argc, char **argv)
+#define NAME_LEN 64
+#define LIST_LEN 64
+
+typedef struct {
+    char host[NAME_LEN];
+    int rank;
+    int thread;
+    int threads;
+    int leader;                 /* lowest world rank on this node */
+    int node_rank, node_size;
+    int online;                 /* CPUs online on this node */
+    int cpu, core, socket, numa;
+    int allowed;                /* CPUs in the affinity mask */
+    int allowed_sockets;        /* sockets those CPUs are on */
+    char list[LIST_LEN];        /* the affinity mask, as 0-3,8 */
+} placement;
+
+/* Integer in /sys/devices/system/cpu/cpuCPU/topology/NAME, or -1. */
+static int topology(int cpu, const char *name)
+{
+    char path[128];
+    FILE *f;
+    int value = -1;
+
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    if ((f = fopen(path, "r")) != NULL) {
+        if (fscanf(f, "%d", &value) != 1) {
+            value = -1;
+        }
+        fclose(f);
+    }
+    return value;
+}
+
+/* NUMA node of CPU, from its nodeN link, or -1. */
+static int numa_node(int cpu)
+{
+    char path[128];
+    struct dirent *entry;
+    DIR *dir;
+    int node = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if ((dir = opendir(path)) != NULL) {
+        while ((entry = readdir(dir)) != NULL) {
+            if (sscanf(entry->d_name, "node%d", &node) == 1) {
+                break;
+            }
+            node = -1;
+        }
+        closedir(dir);
+    }
+    return node;
+}
+
+/* Write SET as a list of ranges into LIST, truncated with "...". */
+static void cpu_list(const cpu_set_t *set, char *list, size_t len)
+{
+    size_t used = 0;
+    int cpu, first;
+
+    list[0] = '\0';
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, set)) {
+            continue;
+        }
+        for (first = cpu; cpu + 1 < CPU_SETSIZE && CPU_ISSET(cpu + 1, set);
+             ++cpu) {
+        }
+        if (used + 24 >= len) {
+            strcpy(list + used, "...");
+            return;
+        }
+        used += snprintf(list + used, len - used, "%s%d", used ? "," : "",
+                         first);
+        if (cpu > first) {
+            used += snprintf(list + used, len - used, "-%d", cpu);
+        }
+    }
+}
+
+static void locate(placement *p)
 {
+    cpu_set_t set;
+    int cpu, sockets[CPU_SETSIZE], nsockets = 0, s, k;
+
+    p->cpu = sched_getcpu();
+    p->core = topology(p->cpu, "core_id");
+    p->socket = topology(p->cpu, "physical_package_id");
+    p->numa = numa_node(p->cpu);
+
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    p->allowed = CPU_COUNT(&set);
+    cpu_list(&set, p->list, sizeof(p->list));
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            s = topology(cpu, "physical_package_id");
+            for (k = 0; k < nsockets && sockets[k] != s; ++k) {
+            }
+            if (k == nsockets) {
+                sockets[nsockets++] = s;
+            }
+        }
+    }
+    p->allowed_sockets = nsockets;
+}
+
+/* Warnings about the placements P[0 .. n-1] of one node. */
+static int check_node(const placement *p, int n)
+{
+    int warnings = 0, i, j;
+
+    if (n > p[0].online) {
+        printf("WARNING: %s runs %d threads on %d CPUs: oversubscribed\n",
+               p[0].host, n, p[0].online);
+        warnings++;
+    }
+    for (i = 0; i < n; ++i) {
+        int shared = 1;
+
+        if (p[i].allowed != 1) {
+            continue;
+        }
+        for (j = 0; j < n; ++j) {
+            if (j != i && p[j].allowed == 1 && p[j].cpu == p[i].cpu) {
+                if (j < i) {
+                    break;
+                }
+                shared++;
+            }
+        }
+        if (j == n && shared > 1) {
+            printf("WARNING: %d threads on %s are bound to CPU %d\n",
+                   shared, p[i].host, p[i].cpu);
+            warnings++;
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        if (p[i].thread == 0 && p[i].allowed == p[i].online
+            && p[i].online > 1) {
+            printf("WARNING: rank %d may run on any CPU of %s; bind it "
+                   "(mpirun --bind-to, OMP_PLACES/OMP_PROC_BIND)\n",
+                   p[i].rank, p[i].host);
+            warnings++;
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        if (p[i].thread != 0) {
+            continue;
+        }
+        for (j = i + 1; j < n && p[j].rank == p[i].rank; ++j) {
+            if (p[j].socket != p[i].socket) {
+                printf("WARNING: rank %d has threads on sockets %d and %d; "
+                       "its memory is remote for some of them\n",
+                       p[i].rank, p[i].socket, p[j].socket);
+                warnings++;
+                break;
+            }
+        }
+        if (j == n || p[j].rank != p[i].rank) {
+            if (p[i].allowed_sockets > 1 && p[i].allowed < p[i].online) {
+                printf("WARNING: rank %d is bound to CPUs %s on %d sockets\n",
+                       p[i].rank, p[i].list, p[i].allowed_sockets);
+                warnings++;
+            }
+        }
+    }
+    return warnings;
+}
+
+int main(int argc, char **argv)
+{
+    MPI_Comm node;
+    placement *mine, *all = NULL;
+    int provided, rank, size, nthreads, leader, node_rank, node_size;
+    int *counts = NULL, *displs = NULL, total = 0, warnings = 0, i, j;
+    char host[MPI_MAX_PROCESSOR_NAME];
+    int len;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Get_processor_name(host, &len);
+
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &node_rank);
+    MPI_Comm_size(node, &node_size);
+    leader = rank;
+    MPI_Bcast(&leader, 1, MPI_INT, 0, node);
+
+    nthreads = omp_get_max_threads();
+    mine = calloc(nthreads, sizeof(placement));
+#pragma omp parallel num_threads(nthreads)
+    {
+        placement *p = &mine[omp_get_thread_num()];
+
+        strncpy(p->host, host, NAME_LEN - 1);
+        p->rank = rank;
+        p->thread = omp_get_thread_num();
+        p->threads = omp_get_num_threads();
+        p->leader = leader;
+        p->node_rank = node_rank;
+        p->node_size = node_size;
+        p->online = sysconf(_SC_NPROCESSORS_ONLN);
+        locate(p);
+    }
+    nthreads = mine[0].threads;
 
+    /* Rank 0 gathers every thread's placement, as bytes. */
+    len = nthreads * sizeof(placement);
+    if (rank == 0) {
+        counts = malloc(size * sizeof(int));
+        displs = malloc(size * sizeof(int));
+    }
+    MPI_Gather(&len, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        for (i = 0; i < size; ++i) {
+            displs[i] = total;
+            total += counts[i];
+        }
+        all = malloc(total);
+    }
+    MPI_Gatherv(mine, len, MPI_BYTE, all, counts, displs, MPI_BYTE, 0,
+                MPI_COMM_WORLD);
 
-MPI_Init(&argc, &argv);
+    if (rank == 0) {
+        int n = total / sizeof(placement);
+        placement *node_p = malloc(total);
 
+        printf("%-16s %5s %7s %4s %4s %6s %4s  %s\n", "host", "rank",
+               "thread", "cpu", "core", "socket", "numa", "affinity");
+        for (i = 0; i < n; ++i) {
+            printf("%-16.16s %5d %3d/%-3d %4d %4d %6d %4d  %s\n",
+                   all[i].host, all[i].rank, all[i].thread, all[i].threads,
+                   all[i].cpu, all[i].core, all[i].socket, all[i].numa,
+                   all[i].list);
+        }
 
-MPI_Finalize();
+        /* Shared memory groups, then the checks for each of them. */
+        printf("\n");
+        for (i = 0; i < n; ++i) {
+            int m = 0;
 
+            if (all[i].thread != 0 || all[i].rank != all[i].leader) {
+                continue;
+            }
+            printf("node %s: %d ranks (", all[i].host, all[i].node_size);
+            for (j = 0; j < n; ++j) {
+                if (all[j].leader == all[i].leader) {
+                    if (all[j].thread == 0) {
+                        printf("%s%d", all[j].node_rank ? " " : "",
+                               all[j].rank);
+                    }
+                    node_p[m++] = all[j];
+                }
+            }
+            printf("), %d threads, %d CPUs online\n", m, all[i].online);
+            warnings += check_node(node_p, m);
+        }
+        if (warnings == 0) {
+            printf("No placement problems found.\n");
+        }
+        free(node_p);
+        free(all);
+        free(displs);
+        free(counts);
+    }
 
+    free(mine);
+    MPI_Comm_free(&node);
+    MPI_Finalize();
+    return 0;
 }
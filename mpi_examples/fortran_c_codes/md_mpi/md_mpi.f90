@@ -0,0 +1,1036 @@
+program main
+
+!*****************************************************************************80
+!
+!! MAIN is the main program for MD_MPI.
+!
+!  Discussion:
+!
+!    MD_MPI carries out the molecular dynamics simulation of MD_OPENMP,
+!    distributing the particles over MPI processes, each of which may use
+!    several OpenMP threads.
+!
+!    The box is cut into slabs along X, one per process, arranged by
+!    MPI_CART_CREATE.  A process owns the particles in its slab; the first
+!    and last slabs extend to minus and plus infinity, since the particles
+!    are not confined to the box.  Only pairs closer than PI2 feel a force,
+!    so each slab must be at least PI2 wide, and then a particle only
+!    interacts with particles of its own and the two neighboring slabs.
+!
+!    At each step:
+!
+!      each process sends the positions of its particles within PI2 of a
+!      slab boundary to the neighbor across it, and appends the "ghost"
+!      particles it receives to its own;
+!
+!      it computes the forces on its own particles from its own and the
+!      ghost particles, found through linked cells, and its share of the
+!      energies;
+!
+!      one MPI_ALLREDUCE sums the potential energy, the kinetic energy,
+!      and the number of pairs within PI2;
+!
+!      UPDATE, unchanged from MD_OPENMP, advances its particles;
+!
+!      the particles that have left the slab are sent, with their
+!      velocities and accelerations, to the neighbor they moved to.
+!      Particles move much less than a slab width per step, so they never
+!      cross more than one boundary.
+!
+!    As in COMPUTE_NEIGHBOR of MD_OPENMP, the pairs beyond PI2 only add
+!    a constant to the potential energy, which is accounted for from the
+!    global count of the pairs within PI2.
+!
+!    The particles start where MD_OPENMP puts them: every process draws
+!    the same sequence of random positions, and keeps those in its slab.
+!    The energies therefore agree with MD_OPENMP up to rounding, whatever
+!    the number of processes and threads.
+!
+!    The options are those of MD_OPENMP, read by process 0 from the
+!    command line or the environment and broadcast.  Usage:
+!
+!      mpirun -np 4 ./md_mpi np=20000 box=21.5 step_num=100
+!
+!    At the end, one line beginning with "SCALING" summarizes the run.
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license.
+!
+!  Author:
+!
+!    Based on MD_OPENMP, by Bill Magro and John Burkardt.
+!
+  use mpi
+  use omp_lib
+
+  implicit none
+
+  integer ( kind = 4 ), parameter :: nd = 3
+
+  real ( kind = 8 ), allocatable :: acc(:,:)
+  real ( kind = 8 ) :: box_side = 10.0D+00
+  integer ( kind = 4 ) comm_cart
+  integer ( kind = 4 ) coords(1)
+  integer ( kind = 4 ) dims(1)
+  real ( kind = 8 ) :: dt = 0.0001D+00
+  real ( kind = 8 ) e0
+  real ( kind = 8 ), allocatable :: force(:,:)
+  real ( kind = 8 ) hi
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) ierr
+  integer ( kind = 4 ) j
+  real ( kind = 8 ) kinetic
+  real ( kind = 8 ) lo
+  real ( kind = 8 ), parameter :: mass = 1.0D+00
+  integer ( kind = 4 ) my_id
+  integer ( kind = 4 ) n_ghost
+  integer ( kind = 4 ) n_local
+  integer ( kind = 4 ) n_max
+  integer ( kind = 4 ) n_range(2)
+  integer ( kind = 4 ) n_range_local(2)
+  integer ( kind = 4 ) nbr_left
+  integer ( kind = 4 ) nbr_right
+  integer ( kind = 4 ) :: np = 1000
+  integer ( kind = 4 ) num_procs
+  integer ( kind = 4 ) params(2)
+  logical periods(1)
+  real ( kind = 8 ), parameter :: PI2 = 3.141592653589793D+00 / 2.0D+00
+  real ( kind = 8 ), allocatable :: pos(:,:)
+  real ( kind = 8 ) potential
+  integer ( kind = 4 ) provided
+  real ( kind = 8 ) r(nd)
+  real ( kind = 8 ) r8_uniform_01
+  real ( kind = 8 ) rparams(2)
+  integer ( kind = 4 ) seed
+  integer ( kind = 4 ) step
+  integer ( kind = 4 ) :: step_num = 400
+  integer ( kind = 4 ) step_print
+  integer ( kind = 4 ) step_print_index
+  integer ( kind = 4 ) step_print_num
+  real ( kind = 8 ), allocatable :: vel(:,:)
+  real ( kind = 8 ) wtime
+
+  call MPI_INIT_THREAD ( MPI_THREAD_FUNNELED, provided, ierr )
+  call MPI_COMM_SIZE ( MPI_COMM_WORLD, num_procs, ierr )
+  call MPI_COMM_RANK ( MPI_COMM_WORLD, my_id, ierr )
+!
+!  Only the main thread calls MPI, between the threaded force and update
+!  loops.
+!
+  if ( provided < MPI_THREAD_FUNNELED ) then
+    if ( my_id == 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'MD_MPI - Fatal error!'
+      write ( *, '(a)' ) '  MPI does not provide MPI_THREAD_FUNNELED.'
+    end if
+    call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+  end if
+!
+!  Process 0 reads the options, and broadcasts them.
+!
+  if ( my_id == 0 ) then
+    call option_get_i4 ( 'np', 'MD_NP', np )
+    call option_get_i4 ( 'step_num', 'MD_STEP_NUM', step_num )
+    call option_get_r8 ( 'dt', 'MD_DT', dt )
+    call option_get_r8 ( 'box', 'MD_BOX', box_side )
+    params(1) = np
+    params(2) = step_num
+    rparams(1) = dt
+    rparams(2) = box_side
+  end if
+
+  call MPI_BCAST ( params, 2, MPI_INTEGER, 0, MPI_COMM_WORLD, ierr )
+  call MPI_BCAST ( rparams, 2, MPI_DOUBLE_PRECISION, 0, MPI_COMM_WORLD, ierr )
+  np = params(1)
+  step_num = params(2)
+  dt = rparams(1)
+  box_side = rparams(2)
+
+  if ( np < 2 .or. box_side < PI2 * dble ( num_procs ) ) then
+    if ( my_id == 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'MD_MPI - Fatal error!'
+      write ( *, '(a)' ) '  NP must be at least 2, and each process needs'
+      write ( *, '(a,g14.6)' ) '  a slab at least PI2 wide: BOX >= ', &
+        PI2 * dble ( num_procs )
+    end if
+    call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+  end if
+!
+!  Arrange the processes in a line along X, and find my slab and my
+!  neighbors.
+!
+  dims(1) = num_procs
+  periods(1) = .false.
+  call MPI_CART_CREATE ( MPI_COMM_WORLD, 1, dims, periods, .true., &
+    comm_cart, ierr )
+  call MPI_COMM_RANK ( comm_cart, my_id, ierr )
+  call MPI_CART_COORDS ( comm_cart, my_id, 1, coords, ierr )
+  call MPI_CART_SHIFT ( comm_cart, 0, 1, nbr_left, nbr_right, ierr )
+
+  lo = box_side * dble ( coords(1) ) / dble ( num_procs )
+  hi = box_side * dble ( coords(1) + 1 ) / dble ( num_procs )
+  if ( coords(1) == 0 ) then
+    lo = - huge ( lo )
+  end if
+  if ( coords(1) == num_procs - 1 ) then
+    hi = huge ( hi )
+  end if
+
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'MD_MPI'
+    write ( *, '(a)' ) '  FORTRAN90/MPI/OpenMP version'
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) '  A molecular dynamics program.'
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,i8)' ) &
+      '  NP, the number of particles in the simulation is ', np
+    write ( *, '(a,i8)' ) '  STEP_NUM, the number of time steps, is ', step_num
+    write ( *, '(a,g14.6)' ) '  DT, the size of each time step, is ', dt
+    write ( *, '(a,g14.6)' ) '  BOX, the side of the box, is ', box_side
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,i8)' ) '  The number of processes is:            ', &
+      num_procs
+    write ( *, '(a,i8)' ) '  The number of threads per process is:  ', &
+      omp_get_max_threads ( )
+  end if
+!
+!  Draw the positions of MD_OPENMP, and keep those in my slab.  Velocities
+!  and accelerations begin at 0.
+!
+  n_max = 0
+  n_local = 0
+  n_ghost = 0
+  call grow ( 2 * ( np / num_procs ) + 64 )
+
+  seed = 123456789
+  do j = 1, np
+    do i = 1, nd
+      r(i) = box_side * r8_uniform_01 ( seed )
+    end do
+    if ( lo <= r(1) .and. r(1) < hi ) then
+      if ( n_max <= n_local ) then
+        call grow ( n_local + 1 )
+      end if
+      n_local = n_local + 1
+      pos(1:nd,n_local) = r(1:nd)
+    end if
+  end do
+!
+!  Compute the initial forces and energies, and save the total energy for
+!  use in the accuracy check.
+!
+  call forces ( )
+
+  e0 = potential + kinetic
+
+  step_print = 0
+  step_print_index = 0
+  step_print_num = 10
+
+  step = 0
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(2x,i8,2x,g14.6,2x,g14.6,2x,g14.6)' ) &
+      step, potential, kinetic, ( potential + kinetic - e0 ) / e0
+  end if
+  step_print_index = step_print_index + 1
+  step_print = ( step_print_index * step_num ) / step_print_num
+
+  call MPI_BARRIER ( comm_cart, ierr )
+  wtime = MPI_WTIME ( )
+
+  do step = 1, step_num
+
+    call forces ( )
+
+    if ( step == step_print ) then
+
+      if ( my_id == 0 ) then
+        write ( *, '(2x,i8,2x,g14.6,2x,g14.6,2x,g14.6)' ) &
+          step, potential, kinetic, ( potential + kinetic - e0 ) / e0
+      end if
+
+      step_print_index = step_print_index + 1
+      step_print = ( step_print_index * step_num ) / step_print_num
+
+    end if
+
+    call update ( n_local, nd, pos, vel, force, acc, mass, dt )
+
+    call migrate ( )
+
+  end do
+
+  wtime = MPI_WTIME ( ) - wtime
+!
+!  The spread of the particle counts shows the load balance.
+!
+  n_range_local(1) = - n_local
+  n_range_local(2) = n_local
+  call MPI_REDUCE ( n_range_local, n_range, 2, MPI_INTEGER, MPI_MAX, 0, &
+    comm_cart, ierr )
+
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) '  Elapsed time for main computation:'
+    write ( *, '(2x,g14.6,a)' ) wtime, ' seconds'
+    write ( *, '(a,i10,a,i10)' ) '  Particles per process: ', &
+      - n_range(1), ' to ', n_range(2)
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,2(1x,i6),2(1x,i10),1x,g14.6)' ) &
+      'SCALING ranks threads np steps seconds', &
+      num_procs, omp_get_max_threads ( ), np, step_num, wtime
+  end if
+
+  deallocate ( acc )
+  deallocate ( force )
+  deallocate ( pos )
+  deallocate ( vel )
+  call MPI_COMM_FREE ( comm_cart, ierr )
+!
+!  Terminate.
+!
+  if ( my_id == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'MD_MPI'
+    write ( *, '(a)' ) '  Normal end of execution.'
+  end if
+
+  call MPI_FINALIZE ( ierr )
+
+  stop
+contains
+  subroutine exchange_ghosts ( )
+
+!*****************************************************************************80
+!
+!! EXCHANGE_GHOSTS appends the ghost particles of both neighbors to POS.
+!
+!  Discussion:
+!
+!    The particles within PI2 of the lower boundary are sent to the left
+!    neighbor, and those within PI2 of the upper boundary to the right one.
+!    The counts are exchanged first, so that POS can be enlarged.  At the
+!    ends of the line the neighbor is MPI_PROC_NULL, and nothing arrives.
+!
+    integer ( kind = 4 ) k
+    integer ( kind = 4 ) n_recv
+    integer ( kind = 4 ) n_send
+    integer ( kind = 4 ) nbr_from
+    integer ( kind = 4 ) nbr_to
+    real ( kind = 8 ), allocatable :: send(:,:)
+    integer ( kind = 4 ) side
+
+    n_ghost = 0
+    allocate ( send(nd,n_local+1) )
+
+    do side = 1, 2
+
+      n_send = 0
+      do k = 1, n_local
+        if ( ( side == 1 .and. pos(1,k) < lo + PI2 ) .or. &
+             ( side == 2 .and. hi - PI2 <= pos(1,k) ) ) then
+          n_send = n_send + 1
+          send(1:nd,n_send) = pos(1:nd,k)
+        end if
+      end do
+
+      if ( side == 1 ) then
+        nbr_to = nbr_left
+        nbr_from = nbr_right
+      else
+        nbr_to = nbr_right
+        nbr_from = nbr_left
+      end if
+
+      n_recv = 0
+      call MPI_SENDRECV ( n_send, 1, MPI_INTEGER, nbr_to, 1, &
+        n_recv, 1, MPI_INTEGER, nbr_from, 1, comm_cart, &
+        MPI_STATUS_IGNORE, ierr )
+
+      if ( n_max < n_local + n_ghost + n_recv + 1 ) then
+        call grow ( n_local + n_ghost + n_recv + 1 )
+      end if
+
+      call MPI_SENDRECV ( send, nd * n_send, MPI_DOUBLE_PRECISION, nbr_to, &
+        2, pos(1,n_local+n_ghost+1), nd * n_recv, MPI_DOUBLE_PRECISION, &
+        nbr_from, 2, comm_cart, MPI_STATUS_IGNORE, ierr )
+
+      n_ghost = n_ghost + n_recv
+
+    end do
+
+    deallocate ( send )
+
+    return
+  end subroutine exchange_ghosts
+  subroutine forces ( )
+
+!*****************************************************************************80
+!
+!! FORCES computes the forces on my particles, and the global energies.
+!
+    real ( kind = 8 ) e(3)
+    real ( kind = 8 ) e_local(3)
+
+    call exchange_ghosts ( )
+
+    call compute_local ( n_local, n_local + n_ghost, nd, pos, vel, force, &
+      e_local(1), e_local(2), e_local(3) )
+
+    call MPI_ALLREDUCE ( e_local, e, 3, MPI_DOUBLE_PRECISION, MPI_SUM, &
+      comm_cart, ierr )
+!
+!  Add the saturated potential of the pairs beyond PI2.
+!
+    potential = e(1) + 0.5D+00 * ( sin ( PI2 ) )**2 &
+      * ( dble ( np ) * dble ( np - 1 ) - e(3) )
+    kinetic = e(2) * 0.5D+00 * mass
+
+    return
+  end subroutine forces
+  subroutine grow ( n )
+
+!*****************************************************************************80
+!
+!! GROW makes room for at least N particles, keeping the ones there are.
+!
+!  Discussion:
+!
+!    The new arrays are first touched by the static partition of the
+!    particles that UPDATE and COMPUTE_LOCAL use.
+!
+    real ( kind = 8 ), allocatable :: a(:,:)
+    integer ( kind = 4 ) k
+    integer ( kind = 4 ) n
+    integer ( kind = 4 ) n_new
+    integer ( kind = 4 ) v
+
+    n_new = max ( n, n_max + n_max / 2 )
+
+    do v = 1, 4
+
+      allocate ( a(nd,n_new) )
+
+!$omp parallel do schedule ( static )
+      do k = 1, n_new
+        a(1:nd,k) = 0.0D+00
+      end do
+!$omp end parallel do
+
+      if ( 0 < n_max ) then
+        select case ( v )
+        case ( 1 )
+          a(1:nd,1:n_max) = pos(1:nd,1:n_max)
+        case ( 2 )
+          a(1:nd,1:n_max) = vel(1:nd,1:n_max)
+        case ( 3 )
+          a(1:nd,1:n_max) = acc(1:nd,1:n_max)
+        case ( 4 )
+          a(1:nd,1:n_max) = force(1:nd,1:n_max)
+        end select
+      end if
+
+      select case ( v )
+      case ( 1 )
+        call move_alloc ( a, pos )
+      case ( 2 )
+        call move_alloc ( a, vel )
+      case ( 3 )
+        call move_alloc ( a, acc )
+      case ( 4 )
+        call move_alloc ( a, force )
+      end select
+
+    end do
+
+    n_max = n_new
+
+    return
+  end subroutine grow
+  subroutine migrate ( )
+
+!*****************************************************************************80
+!
+!! MIGRATE sends the particles that have left my slab to my neighbors.
+!
+!  Discussion:
+!
+!    A particle travels as its position, velocity and acceleration.  The
+!    last particle takes the place of each one that leaves, and the
+!    particles that arrive are appended.
+!
+    integer ( kind = 4 ) k
+    integer ( kind = 4 ) n_recv
+    integer ( kind = 4 ) n_send(2)
+    integer ( kind = 4 ) nbr_from
+    integer ( kind = 4 ) nbr_to
+    real ( kind = 8 ), allocatable :: recv(:,:)
+    real ( kind = 8 ), allocatable :: send(:,:,:)
+    integer ( kind = 4 ) side
+
+    allocate ( send(3*nd,n_local+1,2) )
+    n_send(1:2) = 0
+
+    k = 1
+    do while ( k <= n_local )
+      if ( pos(1,k) < lo ) then
+        side = 1
+      else if ( hi <= pos(1,k) ) then
+        side = 2
+      else
+        k = k + 1
+        cycle
+      end if
+      n_send(side) = n_send(side) + 1
+      send(1:nd,n_send(side),side) = pos(1:nd,k)
+      send(nd+1:2*nd,n_send(side),side) = vel(1:nd,k)
+      send(2*nd+1:3*nd,n_send(side),side) = acc(1:nd,k)
+      pos(1:nd,k) = pos(1:nd,n_local)
+      vel(1:nd,k) = vel(1:nd,n_local)
+      acc(1:nd,k) = acc(1:nd,n_local)
+      n_local = n_local - 1
+    end do
+
+    do side = 1, 2
+
+      if ( side == 1 ) then
+        nbr_to = nbr_left
+        nbr_from = nbr_right
+      else
+        nbr_to = nbr_right
+        nbr_from = nbr_left
+      end if
+
+      n_recv = 0
+      call MPI_SENDRECV ( n_send(side), 1, MPI_INTEGER, nbr_to, 3, &
+        n_recv, 1, MPI_INTEGER, nbr_from, 3, comm_cart, &
+        MPI_STATUS_IGNORE, ierr )
+
+      allocate ( recv(3*nd,n_recv+1) )
+
+      call MPI_SENDRECV ( send(1,1,side), 3 * nd * n_send(side), &
+        MPI_DOUBLE_PRECISION, nbr_to, 4, recv, 3 * nd * n_recv, &
+        MPI_DOUBLE_PRECISION, nbr_from, 4, comm_cart, MPI_STATUS_IGNORE, &
+        ierr )
+
+      if ( n_max < n_local + n_recv ) then
+        call grow ( n_local + n_recv )
+      end if
+
+      do k = 1, n_recv
+        pos(1:nd,n_local+k) = recv(1:nd,k)
+        vel(1:nd,n_local+k) = recv(nd+1:2*nd,k)
+        acc(1:nd,n_local+k) = recv(2*nd+1:3*nd,k)
+      end do
+      n_local = n_local + n_recv
+
+      deallocate ( recv )
+
+    end do
+
+    deallocate ( send )
+
+    return
+  end subroutine migrate
+end
+subroutine compute_local ( n_local, n_total, nd, pos, vel, f, pot, kin, &
+  near )
+
+!*****************************************************************************80
+!
+!! COMPUTE_LOCAL computes the forces on my particles, and my energies.
+!
+!  Discussion:
+!
+!    This computes the forces of COMPUTE_NEIGHBOR of MD_OPENMP, with the
+!    particles in my slab and the ghosts as the candidate neighbors.  Only
+!    the pairs within PI2 contribute; the caller adds the constant
+!    potential of the others.  The energies are not scaled, so that the
+!    caller can sum them over the processes first.
+!
+!    As in NEIGHBOR_BUILD of MD_OPENMP, the bounding box of my particles
+!    and the ghosts is divided into cells whose sides are at least PI2
+!    long, and each particle is threaded onto the linked list of its cell.
+!    The partners of a particle can then only be in its own cell or the 26
+!    cells around it, so the cost is O(N_TOTAL).  The particles move at
+!    every step, so the cells are rebuilt at every call, and no neighbor
+!    list is kept.
+!
+!    The code assumes ND = 3.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) N_LOCAL, the number of my particles.
+!
+!    Input, integer ( kind = 4 ) N_TOTAL, the number of my particles and
+!    ghost particles.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) POS(ND,N_TOTAL), the position of each
+!    particle, mine first.
+!
+!    Input, real ( kind = 8 ) VEL(ND,N_LOCAL), the velocity of each of my
+!    particles.
+!
+!    Output, real ( kind = 8 ) F(ND,N_LOCAL), the forces on my particles.
+!
+!    Output, real ( kind = 8 ) POT, the potential energy of the pairs
+!    within PI2.
+!
+!    Output, real ( kind = 8 ) KIN, the sum of the squared velocities.
+!
+!    Output, real ( kind = 8 ) NEAR, the number of pairs within PI2, each
+!    counted once for each of its particles that is mine.
+!
+  implicit none
+
+  integer ( kind = 4 ) n_local
+  integer ( kind = 4 ) n_total
+  integer ( kind = 4 ) nd
+
+  integer ( kind = 4 ) c(3)
+  integer ( kind = 4 ), allocatable :: cell_head(:)
+  integer ( kind = 4 ), allocatable :: cell_next(:)
+  real ( kind = 8 ) cell_width(3)
+  integer ( kind = 4 ) cx
+  integer ( kind = 4 ) cy
+  integer ( kind = 4 ) cz
+  real ( kind = 8 ) d
+  real ( kind = 8 ) f(nd,n_local)
+  real ( kind = 8 ) hi(3)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) k
+  real ( kind = 8 ) kin
+  real ( kind = 8 ) lo(3)
+  integer ( kind = 4 ) nc(3)
+  integer ( kind = 4 ) nc_max
+  real ( kind = 8 ) near
+  real ( kind = 8 ), parameter :: PI2 = 3.141592653589793D+00 / 2.0D+00
+  real ( kind = 8 ) pos(nd,n_total)
+  real ( kind = 8 ) pot
+  real ( kind = 8 ) rij(nd)
+  real ( kind = 8 ) vel(nd,n_local)
+
+  pot = 0.0D+00
+  kin = 0.0D+00
+  near = 0.0D+00
+
+  if ( n_local == 0 ) then
+    return
+  end if
+!
+!  Choose the cells.  Particles are not confined to the box, so use their
+!  bounding box, and limit the number of cells if they have spread far.
+!
+  nc_max = max ( 1, &
+    nint ( 2.0D+00 * real ( n_total, kind = 8 )**( 1.0D+00 / 3.0D+00 ) ) )
+
+  do k = 1, 3
+    lo(k) = minval ( pos(k,1:n_total) )
+    hi(k) = maxval ( pos(k,1:n_total) )
+    nc(k) = max ( 1, min ( nc_max, int ( ( hi(k) - lo(k) ) / PI2 ) ) )
+    cell_width(k) = &
+      max ( ( hi(k) - lo(k) ) / real ( nc(k), kind = 8 ), PI2 )
+  end do
+
+  allocate ( cell_head(0:nc(1)*nc(2)*nc(3)-1) )
+  allocate ( cell_next(n_total) )
+!
+!  Thread the particles onto the cells in decreasing order, so that each
+!  cell lists its particles in increasing order.
+!
+  cell_head(:) = 0
+
+  do i = n_total, 1, -1
+    do k = 1, 3
+      c(k) = min ( nc(k) - 1, int ( ( pos(k,i) - lo(k) ) / cell_width(k) ) )
+    end do
+    j = c(1) + nc(1) * ( c(2) + nc(2) * c(3) )
+    cell_next(i) = cell_head(j)
+    cell_head(j) = i
+  end do
+
+!$omp parallel &
+!$omp shared ( cell_head, cell_next, cell_width, f, lo, n_local, nc, nd, &
+!$omp   pos, vel ) &
+!$omp private ( c, cx, cy, cz, d, i, j, k, rij )
+
+!$omp do schedule ( static ) reduction ( + : pot, kin, near )
+
+  do i = 1, n_local
+
+    f(1:nd,i) = 0.0D+00
+
+    do k = 1, 3
+      c(k) = min ( nc(k) - 1, int ( ( pos(k,i) - lo(k) ) / cell_width(k) ) )
+    end do
+
+    do cz = max ( 0, c(3) - 1 ), min ( nc(3) - 1, c(3) + 1 )
+      do cy = max ( 0, c(2) - 1 ), min ( nc(2) - 1, c(2) + 1 )
+        do cx = max ( 0, c(1) - 1 ), min ( nc(1) - 1, c(1) + 1 )
+
+          j = cell_head(cx + nc(1) * ( cy + nc(2) * cz ))
+
+          do while ( j /= 0 )
+
+            if ( j /= i ) then
+
+              call dist ( nd, pos(1,i), pos(1,j), rij, d )
+
+              if ( d < PI2 ) then
+
+                pot = pot + 0.5D+00 * ( sin ( d ) )**2
+
+                f(1:nd,i) = f(1:nd,i) - rij(1:nd) * sin ( 2.0D+00 * d ) / d
+
+                near = near + 1.0D+00
+
+              end if
+
+            end if
+
+            j = cell_next(j)
+
+          end do
+
+        end do
+      end do
+    end do
+
+    kin = kin + sum ( vel(1:nd,i)**2 )
+
+  end do
+!$omp end do
+
+!$omp end parallel
+
+  deallocate ( cell_head )
+  deallocate ( cell_next )
+
+  return
+end
+subroutine dist ( nd, r1, r2, dr, d )
+
+!*****************************************************************************80
+!
+!! DIST computes the displacement and distance between two particles.
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license. 
+!
+!  Modified:
+!
+!    17 March 2002
+!
+!  Author:
+!
+!    Original FORTRAN90 version by Bill Magro.
+!    This FORTRAN90 version by John Burkardt.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) R1(ND), R2(ND), the positions of the particles.
+!
+!    Output, real ( kind = 8 ) DR(ND), the displacement vector.
+!
+!    Output, real ( kind = 8 ) D, the Euclidean norm of the displacement,
+!    in other words, the distance between the two particles.
+!
+  implicit none
+
+  integer ( kind = 4 ) nd
+
+  real ( kind = 8 ) d
+  real ( kind = 8 ) dr(nd)
+  real ( kind = 8 ) r1(nd)
+  real ( kind = 8 ) r2(nd)
+
+  dr(1:nd) = r1(1:nd) - r2(1:nd)
+
+  d = sqrt ( sum ( dr(1:nd)**2 ) )
+
+  return
+end
+subroutine option_get ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET returns the value of a run time option.
+!
+!  Discussion:
+!
+!    The option NAME may be given on the command line as NAME=VALUE, or
+!    in the environment variable ENV_NAME.  The command line takes
+!    precedence.  If the option is not given, VALUE is unchanged.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, character ( len = * ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = 255 ) arg
+  character ( len = * ) env_name
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) k
+  integer ( kind = 4 ) length
+  character ( len = * ) name
+  integer ( kind = 4 ) status
+  character ( len = * ) value
+
+  do i = 1, command_argument_count ( )
+    call get_command_argument ( i, arg )
+    k = index ( arg, '=' )
+    if ( 1 < k ) then
+      if ( arg(1:k-1) == name ) then
+        value = arg(k+1:)
+        return
+      end if
+    end if
+  end do
+
+  call get_environment_variable ( env_name, arg, length, status )
+  if ( status == 0 .and. 0 < length ) then
+    value = arg
+  end if
+
+  return
+end
+subroutine option_get_i4 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_I4 returns the value of an integer run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, integer ( kind = 4 ) VALUE, the value of the option.
+!
+  use mpi
+
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ierr
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  integer ( kind = 4 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_I4 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+    end if
+  end if
+
+  return
+end
+subroutine option_get_r8 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_R8 returns the value of a real run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, real ( kind = 8 ) VALUE, the value of the option.
+!
+  use mpi
+
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ierr
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  real ( kind = 8 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_R8 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      call MPI_ABORT ( MPI_COMM_WORLD, 1, ierr )
+    end if
+  end if
+
+  return
+end
+function r8_uniform_01 ( seed )
+
+!*****************************************************************************80
+!
+!! R8_UNIFORM_01 returns a unit pseudorandom R8.
+!
+!  Discussion:
+!
+!    This routine implements the recursion
+!
+!      seed = 16807 * seed mod ( 2**31 - 1 )
+!      r8_uniform_01 = seed / ( 2**31 - 1 )
+!
+!    The integer arithmetic never requires more than 32 bits,
+!    including a sign bit.
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license.
+!
+!  Modified:
+!
+!    05 July 2006
+!
+!  Author:
+!
+!    John Burkardt
+!
+!  Parameters:
+!
+!    Input/output, integer ( kind = 4 ) SEED, the "seed" value, which should
+!    NOT be 0.  On output, SEED has been updated.
+!
+!    Output, real ( kind = 8 ) R8_UNIFORM_01, a new pseudorandom variate,
+!    strictly between 0 and 1.
+!
+  implicit none
+
+  integer ( kind = 4 ), parameter :: i4_huge = 2147483647
+  integer ( kind = 4 ) k
+  real ( kind = 8 ) r8_uniform_01
+  integer ( kind = 4 ) seed
+
+  if ( seed == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'R8_UNIFORM_01 - Fatal error!'
+    write ( *, '(a)' ) '  Input value of SEED = 0.'
+    stop 1
+  end if
+
+  k = seed / 127773
+
+  seed = 16807 * ( seed - k * 127773 ) - k * 2836
+
+  if ( seed < 0 ) then
+    seed = seed + i4_huge
+  end if
+
+  r8_uniform_01 = real ( seed, kind = 8 ) * 4.656612875D-10
+
+  return
+end
+subroutine update ( np, nd, pos, vel, f, acc, mass, dt )
+
+!*****************************************************************************80
+!
+!! UPDATE updates positions, velocities and accelerations.
+!
+!  Discussion:
+!
+!    The time integration is fully parallel.
+!
+!    A velocity Verlet algorithm is used for the updating.
+!
+!    x(t+dt) = x(t) + v(t) * dt + 0.5 * a(t) * dt * dt
+!    v(t+dt) = v(t) + 0.5 * ( a(t) + a(t+dt) ) * dt
+!    a(t+dt) = f(t) / m
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license. 
+!
+!  Modified:
+!
+!    21 November 2007
+!
+!  Author:
+!
+!    Original FORTRAN90 version by Bill Magro.
+!    This FORTRAN90 version by John Burkardt.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP, the number of particles.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input/output, real ( kind = 8 ) POS(ND,NP), the position of each particle.
+!
+!    Input/output, real ( kind = 8 ) VEL(ND,NP), the velocity of each particle.
+!
+!    Input, real ( kind = 8 ) F(ND,NP), the force on each particle.
+!
+!    Input/output, real ( kind = 8 ) ACC(ND,NP), the acceleration of each
+!    particle.
+!
+!    Input, real ( kind = 8 ) MASS, the mass of each particle.
+!
+!    Input, real ( kind = 8 ) DT, the time step.
+!
+  implicit none
+
+  integer ( kind = 4 ) np
+  integer ( kind = 4 ) nd
+
+  real ( kind = 8 ) acc(nd,np)
+  real ( kind = 8 ) dt
+  real ( kind = 8 ) f(nd,np)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  real ( kind = 8 ) mass
+  real ( kind = 8 ) pos(nd,np)
+  real ( kind = 8 ) rmass
+  real ( kind = 8 ) vel(nd,np)
+
+  rmass = 1.0D+00 / mass
+
+!$omp parallel &
+!$omp shared ( acc, dt, f, nd, np, pos, rmass, vel ) &
+!$omp private ( i, j )
+
+!$omp do schedule ( static )
+  do j = 1, np
+    do i = 1, nd
+      pos(i,j) = pos(i,j) + vel(i,j) * dt + 0.5D+00 * acc(i,j) * dt * dt
+      vel(i,j) = vel(i,j) + 0.5D+00 * dt * ( f(i,j) * rmass + acc(i,j) )
+      acc(i,j) = f(i,j) * rmass
+    end do
+  end do
+!$omp end do
+
+!$omp end parallel
+
+  return
+end
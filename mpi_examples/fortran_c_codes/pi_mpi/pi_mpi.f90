@@ -1,32 +1,168 @@
 PROGRAM pi_mpi 
 use mpi 
-double precision mypi, pi, h, x, f, a
-integer n, myid, numprocs, i, ierr
+!$ use omp_lib
+double precision mypi, pi, h, x, wtime
+integer(kind=8) n, i, j, lo, hi, part
+integer myid, numprocs, ierr, ios, provided, threads
+integer fixed_type, fixed_sum_op
+integer(kind=16) myfixed, fixed
+logical exact, block
+character(len=255) arg
+external fixed_sum
  
-call MPI_INIT( ierr )
+call MPI_INIT_THREAD( MPI_THREAD_FUNNELED, provided, ierr )
 call MPI_COMM_RANK( MPI_COMM_WORLD, myid, ierr )
 call MPI_COMM_SIZE( MPI_COMM_WORLD, numprocs, ierr )
 
-if (myid .eq. 0) n = 900000000
+! dist=block runs OpenMP threads, of which only the master calls MPI
+if (provided .lt. MPI_THREAD_FUNNELED) then
+    if (myid .eq. 0) write(*,*) 'MPI does not provide MPI_THREAD_FUNNELED'
+    call MPI_ABORT(MPI_COMM_WORLD, 1, ierr)
+end if
+
+! number of terms: n=<terms> on the command line, or PI_N in the environment
+if (myid .eq. 0) then
+    n = 900000000
+    call option_get('n', 'PI_N', arg)
+    ios = 0
+    if (len_trim(arg) .ne. 0) read(arg,*,iostat=ios) n
+    if (ios .ne. 0 .or. n .le. 0) then
+        write(*,*) 'Bad n ', trim(arg), '; n must be a positive integer'
+        call MPI_ABORT(MPI_COMM_WORLD, 1, ierr)
+    end if
+! sum=exact gives the same bits for any number of ranks
+    call option_get('sum', 'PI_SUM', arg)
+    exact = arg .eq. 'exact'
+    if (.not. exact .and. len_trim(arg) .ne. 0 .and. arg .ne. 'plain') then
+        write(*,*) 'Unknown sum ', trim(arg), '; choose plain or exact'
+        call MPI_ABORT(MPI_COMM_WORLD, 1, ierr)
+    end if
+! dist=block gives each rank one contiguous range, shared by its threads
+    call option_get('dist', 'PI_DIST', arg)
+    block = arg .eq. 'block'
+    if (.not. block .and. len_trim(arg) .ne. 0 .and. arg .ne. 'cyclic') then
+        write(*,*) 'Unknown dist ', trim(arg), '; choose cyclic or block'
+        call MPI_ABORT(MPI_COMM_WORLD, 1, ierr)
+    end if
+end if
 
-call MPI_BCAST(n,1,MPI_INTEGER,0,MPI_COMM_WORLD,ierr)
+call MPI_BCAST(n,1,MPI_INTEGER8,0,MPI_COMM_WORLD,ierr)
+call MPI_BCAST(exact,1,MPI_LOGICAL,0,MPI_COMM_WORLD,ierr)
+call MPI_BCAST(block,1,MPI_LOGICAL,0,MPI_COMM_WORLD,ierr)
     
-h = 1.0D+0 / REAL (n) ! trapezoid base
+wtime = MPI_WTIME()
+h = 1.0D+0 / dble (n) ! trapezoid base
 mypi = 0.0D+0
+myfixed = 0
+threads = 1
+
+! Every term lies in [2,4], so it is an exact multiple of 2**-51: for
+! sum=exact the terms are summed as 128 bit fixed point integers, which is
+! exact and so does not depend on the order of the additions.
+if (block) then
+    lo = n / numprocs * myid + min(int(myid, 8), mod(n, int(numprocs, 8))) + 1
+    hi = lo + n / numprocs - 1
+    if (myid .lt. mod(n, int(numprocs, 8))) hi = hi + 1
+!$omp parallel
+!$omp master
+!$  threads = omp_get_num_threads()
+!$omp end master
+    if (exact) then
+! 64 bit partial sums of (term - 2) * 2**51 <= 2**52 over 1024 terms
+!$omp do reduction(+:myfixed) private(x, part, j)
+        do i = lo, hi, 1024
+            part = 0
+!$omp simd reduction(+:part) private(x)
+            do j = i, min(i + 1023, hi)
+                x = h * ( dble (j) - 0.5D+0)
+                part = part &
+                    + int((4.0D+0 / (1.0D+0 + x * x) - 2.0D+0) * 2.0D+0**51, 8)
+            end do
+            myfixed = myfixed + part + (min(i + 1023, hi) - i + 1) * 2_16**52
+        end do
+!$omp end do
+    else
+!$omp do simd reduction(+:mypi) private(x)
+        do i = lo, hi
+            x = h * ( dble (i) - 0.5D+0)
+            mypi = mypi + 4.0D+0 / (1.0D+0 + x * x)
+        end do
+!$omp end do simd
+    end if
+!$omp end parallel
+else if (exact) then
+    do i = myid+1, n, numprocs ! cyclic distribution
+        x = h * ( dble (i) - 0.5D+0)
+        myfixed = myfixed + int(4.0D+0 / (1.0D+0 + x * x) * 2.0D+0**51, 16)
+    end do
+else
+    do i = myid+1, n, numprocs ! cyclic distribution
+        x = h * ( dble (i) - 0.5D+0)
+        mypi = mypi + 4.0D+0 / (1.0D+0 + x * x)
+    end do
+end if
 
-do i = myid+1, n, numprocs ! cyclic distribution
-    x = h * ( REAL (i) - 0.5D+0)
-    mypi = mypi + 4.0D+0 / (1.0D+0 + x * x)
-end do
 !!!!!collect partial sums!!!!!!!!!!!!!!!!
-call MPI_REDUCE(mypi, pi, 1, MPI_REAL8, & 
-    MPI_SUM, 0, MPI_COMM_WORLD,ierr)
+if (exact) then
+    call MPI_TYPE_CONTIGUOUS(2, MPI_INTEGER8, fixed_type, ierr)
+    call MPI_TYPE_COMMIT(fixed_type, ierr)
+    call MPI_OP_CREATE(fixed_sum, .true., fixed_sum_op, ierr)
+    call MPI_REDUCE(myfixed, fixed, 1, fixed_type, &
+        fixed_sum_op, 0, MPI_COMM_WORLD, ierr)
+    call MPI_OP_FREE(fixed_sum_op, ierr)
+    call MPI_TYPE_FREE(fixed_type, ierr)
+    pi = real(fixed, 8) * 2.0D+0**(-51)
+else
+    call MPI_REDUCE(mypi, pi, 1, MPI_REAL8, &
+        MPI_SUM, 0, MPI_COMM_WORLD,ierr)
+end if
+wtime = MPI_WTIME() - wtime
 
 if (myid .eq. 0) then
     pi=pi*h
     write(*,*) pi
+    write(*,'(a,i0,a,i0,a,f0.6,a,es10.4,a)') 'ranks ', numprocs, &
+        ' threads ', threads, ' time ', wtime, ' s ', n / wtime, ' terms/s'
 end if
 
 call MPI_FINALIZE(ierr)
 end program pi_mpi
 
+! value of option name, given as name=value on the command line or in the
+! environment variable env_name; blank if it is not set
+subroutine option_get(name, env_name, value)
+implicit none
+character(len=*) name, env_name, value
+character(len=255) arg
+integer i, k
+
+value = ' '
+do i = 1, command_argument_count()
+    call get_command_argument(i, arg)
+    k = index(arg, '=')
+    if (k .gt. 1) then
+        if (arg(1:k-1) .eq. name) then
+            value = arg(k+1:)
+            return
+        end if
+    end if
+end do
+call get_environment_variable(env_name, value)
+end subroutine option_get
+
+! MPI_Op for sum=exact: add 128 bit fixed point partial sums, which
+! travel as the 2 x MPI_INTEGER8 contiguous type
+subroutine fixed_sum(invec, inoutvec, len, datatype)
+use mpi
+implicit none
+integer len, datatype
+integer(kind=16) invec(len), inoutvec(len)
+integer bytes, ierr
+
+call MPI_TYPE_SIZE(datatype, bytes, ierr)
+if (bytes .ne. 16) then
+    write(*,*) 'fixed_sum: datatype is ', bytes, ' bytes, not 16'
+    call MPI_ABORT(MPI_COMM_WORLD, 1, ierr)
+end if
+inoutvec = inoutvec + invec
+end subroutine fixed_sum
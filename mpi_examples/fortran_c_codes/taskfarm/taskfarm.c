@@ -0,0 +1,278 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include "taskfarm.h"
+
+#define TAG_TASK 1
+#define TAG_RESULT 2
+#define STOP (-1L)
+
+/* The message a worker sends back for each task. */
+typedef struct {
+    long task;
+    double value;
+    int worker;
+} taskfarm_result;
+
+void taskfarm_default_options(taskfarm_options *options)
+{
+    options->mode = TASKFARM_MASTER;
+    options->prefetch = 4;
+    options->chunk = 1;
+}
+
+static MPI_Datatype result_type(void)
+{
+    int lengths[3] = { 1, 1, 1 };
+    MPI_Aint displs[3] = {
+        offsetof(taskfarm_result, task),
+        offsetof(taskfarm_result, value),
+        offsetof(taskfarm_result, worker)
+    };
+    MPI_Datatype types[3] = { MPI_LONG, MPI_DOUBLE, MPI_INT };
+    MPI_Datatype tmp, type;
+
+    MPI_Type_create_struct(3, lengths, displs, types, &tmp);
+    MPI_Type_create_resized(tmp, 0, sizeof(taskfarm_result), &type);
+    MPI_Type_free(&tmp);
+    MPI_Type_commit(&type);
+    return type;
+}
+
+static double run_task(long task, taskfarm_fn fn, void *arg,
+                       taskfarm_stats *stats)
+{
+    double t = MPI_Wtime();
+    double value = fn(task, arg);
+
+    stats->busy += MPI_Wtime() - t;
+    stats->tasks++;
+    return value;
+}
+
+/*
+ * The master's task messages are nonblocking, so it never waits on a
+ * worker that is itself blocked sending a result.  Worker W has SLOTS
+ * send buffers, used in turn: at most PREFETCH tasks and a STOP are in
+ * flight, so by the time a slot comes round again the worker has
+ * received its message, and the wait for it returns at once.
+ */
+typedef struct {
+    MPI_Comm comm;
+    int slots;
+    long *buf;
+    MPI_Request *req;
+    int *sent;
+} task_sender;
+
+static void send_task(task_sender *ts, int w, long task)
+{
+    int s = w * ts->slots + ts->sent[w]++ % ts->slots;
+
+    MPI_Wait(&ts->req[s], MPI_STATUS_IGNORE);
+    ts->buf[s] = task;
+    MPI_Isend(&ts->buf[s], 1, MPI_LONG, w + 1, TAG_TASK, ts->comm,
+              &ts->req[s]);
+}
+
+/* Send STOP to every worker; each sees it after the tasks queued before. */
+static void stop_workers(task_sender *ts, int nworkers)
+{
+    int w;
+
+    for (w = 0; w < nworkers; ++w) {
+        send_task(ts, w, STOP);
+    }
+}
+
+static double run_master(MPI_Comm comm, long ntasks, taskfarm_fn fn,
+                         void *arg, const taskfarm_options *options,
+                         taskfarm_stats *stats)
+{
+    MPI_Datatype type;
+    double sum = 0.0;
+    int rank, size;
+    long task;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    if (size == 1) {
+        for (task = 0; task < ntasks; ++task) {
+            sum += run_task(task, fn, arg, stats);
+        }
+        return sum;
+    }
+
+    type = result_type();
+    if (rank == 0) {
+        int nworkers = size - 1;
+        taskfarm_result *results = malloc(nworkers * sizeof(*results));
+        MPI_Request *requests = malloc(nworkers * sizeof(*requests));
+        int *outstanding = calloc(nworkers, sizeof(*outstanding));
+        task_sender ts;
+        long next = 0, received = 0;
+        int p, w;
+
+        ts.comm = comm;
+        ts.slots = options->prefetch + 1;
+        ts.buf = malloc(nworkers * ts.slots * sizeof(*ts.buf));
+        ts.req = malloc(nworkers * ts.slots * sizeof(*ts.req));
+        ts.sent = calloc(nworkers, sizeof(*ts.sent));
+        for (p = 0; p < nworkers * ts.slots; ++p) {
+            ts.req[p] = MPI_REQUEST_NULL;
+        }
+
+        /* Deal out up to prefetch tasks per worker, round robin. */
+        for (p = 0; p < options->prefetch; ++p) {
+            for (w = 0; w < nworkers && next < ntasks; ++w) {
+                send_task(&ts, w, next);
+                outstanding[w]++;
+                next++;
+            }
+        }
+        if (next == ntasks) {
+            stop_workers(&ts, nworkers);
+        }
+        for (w = 0; w < nworkers; ++w) {
+            requests[w] = MPI_REQUEST_NULL;
+            if (outstanding[w] > 0) {
+                MPI_Irecv(&results[w], 1, type, w + 1, TAG_RESULT, comm,
+                          &requests[w]);
+            }
+        }
+
+        /* Replace each finished task with a new one for the same worker. */
+        while (received < ntasks) {
+            MPI_Waitany(nworkers, requests, &w, MPI_STATUS_IGNORE);
+            w = results[w].worker - 1;
+            sum += results[w].value;
+            received++;
+            outstanding[w]--;
+            if (next < ntasks) {
+                send_task(&ts, w, next);
+                outstanding[w]++;
+                if (++next == ntasks) {
+                    stop_workers(&ts, nworkers);
+                }
+            }
+            if (outstanding[w] > 0) {
+                MPI_Irecv(&results[w], 1, type, w + 1, TAG_RESULT, comm,
+                          &requests[w]);
+            }
+        }
+        MPI_Waitall(nworkers * ts.slots, ts.req, MPI_STATUSES_IGNORE);
+        free(ts.sent);
+        free(ts.req);
+        free(ts.buf);
+        free(outstanding);
+        free(requests);
+        free(results);
+    } else {
+        taskfarm_result result;
+
+        result.worker = rank;
+        for (;;) {
+            MPI_Recv(&task, 1, MPI_LONG, 0, TAG_TASK, comm,
+                     MPI_STATUS_IGNORE);
+            if (task == STOP) {
+                break;
+            }
+            result.task = task;
+            result.value = run_task(task, fn, arg, stats);
+            MPI_Send(&result, 1, type, 0, TAG_RESULT, comm);
+        }
+    }
+    MPI_Type_free(&type);
+
+    MPI_Bcast(&sum, 1, MPI_DOUBLE, 0, comm);
+    return sum;
+}
+
+/* First task of rank R's block. */
+static long block_start(long ntasks, int size, int r)
+{
+    long rem = ntasks % size;
+
+    return ntasks / size * r + (r < rem ? r : rem);
+}
+
+static double run_steal(MPI_Comm comm, long ntasks, taskfarm_fn fn,
+                        void *arg, const taskfarm_options *options,
+                        taskfarm_stats *stats)
+{
+    MPI_Win win;
+    long *next;
+    long chunk = options->chunk;
+    double sum = 0.0, total;
+    int rank, size, v;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    /* Each rank's window holds the next unclaimed task of its block. */
+    MPI_Win_allocate(sizeof(long), sizeof(long), MPI_INFO_NULL, comm,
+                     &next, &win);
+    MPI_Win_lock_all(0, win);
+    *next = block_start(ntasks, size, rank);
+    MPI_Win_sync(win);
+    MPI_Barrier(comm);
+
+    /* Own block first, then the other ranks' blocks in turn. */
+    for (v = 0; v < size; ++v) {
+        int victim = (rank + v) % size;
+        long end = block_start(ntasks, size, victim + 1);
+        long first, task;
+
+        for (;;) {
+            MPI_Fetch_and_op(&chunk, &first, MPI_LONG, victim, 0, MPI_SUM,
+                             win);
+            MPI_Win_flush(victim, win);
+            if (first >= end) {
+                break;
+            }
+            for (task = first; task < end && task < first + chunk; ++task) {
+                sum += run_task(task, fn, arg, stats);
+                if (v > 0) {
+                    stats->stolen++;
+                }
+            }
+        }
+    }
+
+    MPI_Win_unlock_all(win);
+    MPI_Allreduce(&sum, &total, 1, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Win_free(&win);
+    return total;
+}
+
+double taskfarm_run(MPI_Comm comm, long ntasks, taskfarm_fn fn, void *arg,
+                    const taskfarm_options *options, taskfarm_stats *stats)
+{
+    taskfarm_options defaults;
+    taskfarm_stats local = { 0, 0, 0.0, 0.0 };
+    double wall = MPI_Wtime();
+    double sum;
+
+    if (options == NULL) {
+        taskfarm_default_options(&defaults);
+        options = &defaults;
+    }
+    if (options->prefetch < 1 || options->chunk < 1) {
+        fprintf(stderr, "taskfarm_run: prefetch and chunk must be at "
+                "least 1 (got %d and %ld)\n", options->prefetch,
+                options->chunk);
+        MPI_Abort(comm, 1);
+    }
+    if (options->mode == TASKFARM_STEAL) {
+        sum = run_steal(comm, ntasks, fn, arg, options, &local);
+    } else {
+        sum = run_master(comm, ntasks, fn, arg, options, &local);
+    }
+    local.wall = MPI_Wtime() - wall;
+    if (stats != NULL) {
+        *stats = local;
+    }
+    return sum;
+}
@@ -0,0 +1,47 @@
+#ifndef TASKFARM_H
+#define TASKFARM_H
+
+#include <mpi.h>
+
+/*
+ * A task farm: tasks 0 .. ntasks-1 are handed out to the ranks of a
+ * communicator, each task returns a double, and the results are summed.
+ *
+ * TASKFARM_MASTER  rank 0 hands out tasks and collects results.  Each
+ *                  worker holds up to `prefetch` tasks, so it never waits
+ *                  for the master between tasks, and returns each result,
+ *                  with its rank and task number, in one message.
+ * TASKFARM_STEAL   no master: every rank starts with a contiguous block of
+ *                  tasks and claims `chunk` at a time from it with an
+ *                  atomic MPI_Fetch_and_op; a rank that runs out claims
+ *                  tasks from the other ranks' blocks the same way.
+ */
+enum taskfarm_mode { TASKFARM_MASTER, TASKFARM_STEAL };
+
+typedef double (*taskfarm_fn)(long task, void *arg);
+
+typedef struct {
+    enum taskfarm_mode mode;
+    int prefetch;               /* tasks in flight per worker (master) */
+    long chunk;                 /* tasks claimed at a time (steal) */
+} taskfarm_options;
+
+typedef struct {
+    long tasks;                 /* tasks run by this rank */
+    long stolen;                /* of which taken from other ranks */
+    double busy;                /* seconds spent in the task function */
+    double wall;                /* seconds in taskfarm_run */
+} taskfarm_stats;
+
+/* Defaults: master mode, 4 tasks in flight, chunks of 1. */
+void taskfarm_default_options(taskfarm_options *options);
+
+/*
+ * Run FN(task, ARG) for every task and return the sum of the results on
+ * every rank of COMM.  STATS, if not NULL, receives this rank's counts.
+ * A prefetch or chunk below 1 aborts COMM.
+ */
+double taskfarm_run(MPI_Comm comm, long ntasks, taskfarm_fn fn, void *arg,
+                    const taskfarm_options *options, taskfarm_stats *stats);
+
+#endif
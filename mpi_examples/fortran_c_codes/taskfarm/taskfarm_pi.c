@@ -0,0 +1,144 @@
+/*
+ * pi by the Leibniz series, farmed out in slices with taskfarm.c; the C
+ * version of python/mpipypi.py.
+ *
+ *   mpicc -O3 -o taskfarm_pi taskfarm_pi.c taskfarm.c
+ *   mpirun -np <N> ./taskfarm_pi [slices=50] [slice_size=1000000]
+ *                                [mode=master|steal] [prefetch=4] [chunk=1]
+ *
+ * Each option can also be set in the environment as TASKFARM_<NAME>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <mpi.h>
+#include "taskfarm.h"
+
+/*
+ * Return the value of option NAME, given on the command line as NAME=VALUE
+ * or in the environment variable ENV_NAME, or NULL if it is not set.
+ * The command line takes precedence.
+ */
+static const char *option_string(int argc, char **argv, const char *name,
+                                 const char *env_name)
+{
+    size_t len = strlen(name);
+    const char *value = NULL;
+    int k;
+
+    for (k = 1; k < argc; ++k) {
+        if (strncmp(argv[k], name, len) == 0 && argv[k][len] == '=') {
+            value = argv[k] + len + 1;
+        }
+    }
+    if (value == NULL) {
+        value = getenv(env_name);
+    }
+    if (value != NULL && *value == '\0') {
+        value = NULL;
+    }
+    return value;
+}
+
+/*
+ * Return the value of the integer option NAME (see option_string), or
+ * DEFAULT_VALUE if it is not set.
+ */
+static long option_long(int argc, char **argv, const char *name,
+                        const char *env_name, long default_value)
+{
+    const char *value = option_string(argc, argv, name, env_name);
+    char *end;
+    long result;
+
+    if (value == NULL) {
+        return default_value;
+    }
+    result = strtol(value, &end, 10);
+    if (*end != '\0' || result <= 0) {
+        fprintf(stderr, "Bad value for %s: %s\n", name, value);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return result;
+}
+
+/*
+ * Sum of (-1)^i / (2i+1) over the SLICE-th block of slice_size terms,
+ * taking the terms in pairs so that the loop has no sign test.
+ */
+static double leibniz_slice(long slice, void *arg)
+{
+    long slice_size = *(long *) arg;
+    long first = slice * slice_size, i;
+    double sum = 0.0;
+
+    for (i = first; i + 1 < first + slice_size; i += 2) {
+        sum += 1.0 / (2.0 * i + 1.0) - 1.0 / (2.0 * i + 3.0);
+    }
+    if (first % 2 != 0) {
+        sum = -sum;
+    }
+    if (i < first + slice_size) {
+        sum += (i % 2 == 0 ? 1.0 : -1.0) / (2.0 * i + 1.0);
+    }
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    taskfarm_options options;
+    taskfarm_stats stats;
+    long slices, slice_size, totals[2], counts[2];
+    double pi, busy, wall;
+    const char *mode;
+    int rank, size;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    taskfarm_default_options(&options);
+    slices = option_long(argc, argv, "slices", "TASKFARM_SLICES", 50);
+    slice_size = option_long(argc, argv, "slice_size",
+                             "TASKFARM_SLICE_SIZE", 1000000);
+    options.prefetch = option_long(argc, argv, "prefetch",
+                                   "TASKFARM_PREFETCH", options.prefetch);
+    options.chunk = option_long(argc, argv, "chunk", "TASKFARM_CHUNK",
+                                options.chunk);
+    mode = option_string(argc, argv, "mode", "TASKFARM_MODE");
+    if (mode == NULL || strcmp(mode, "master") == 0) {
+        mode = "master";
+        options.mode = TASKFARM_MASTER;
+    } else if (strcmp(mode, "steal") == 0) {
+        options.mode = TASKFARM_STEAL;
+    } else {
+        if (rank == 0) {
+            fprintf(stderr, "Unknown mode %s; choose master or steal\n", mode);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    pi = 4.0 * taskfarm_run(MPI_COMM_WORLD, slices, leibniz_slice,
+                            &slice_size, &options, &stats);
+
+    counts[0] = stats.tasks;
+    counts[1] = stats.stolen;
+    MPI_Reduce(counts, totals, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&stats.busy, &busy, 1, MPI_DOUBLE, MPI_SUM, 0,
+               MPI_COMM_WORLD);
+    MPI_Reduce(&stats.wall, &wall, 1, MPI_DOUBLE, MPI_MAX, 0,
+               MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("Pi is %.16f, error %.3e\n", pi, fabs(pi - M_PI));
+        printf("%d ranks, mode %s, %ld slices of %ld terms, "
+               "%ld tasks run, %ld stolen\n",
+               size, mode, slices, slice_size, totals[0], totals[1]);
+        printf("time %.6f s, %.4g terms/s, busy %.1f%%\n", wall,
+               (double) slices * slice_size / wall,
+               100.0 * busy / (wall * size));
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -1,18 +1,24 @@
 #!/usr/bin/env python
 """
 Hello World, parallel
+
+Each process also reports the CPUs it may run on, and its rank among the
+processes sharing its node (see fortran_c_codes/layout for the details).
 """
 
 from mpi4py import MPI
+import os
 import sys
 
 size = MPI.COMM_WORLD.Get_size()
 rank = MPI.COMM_WORLD.Get_rank()
 name = MPI.Get_processor_name()
 
-sys.stdout.write(
-    "Hello, World! I am process %d of %d on %s.\n"
-    % (rank, size, name))
-
-
+node = MPI.COMM_WORLD.Split_type(MPI.COMM_TYPE_SHARED)
+cpus = sorted(os.sched_getaffinity(0))
 
+sys.stdout.write(
+    "Hello, World! I am process %d of %d on %s, %d of %d on the node, "
+    "CPUs %s.\n"
+    % (rank, size, name, node.Get_rank(), node.Get_size(),
+       ",".join(str(c) for c in cpus)))
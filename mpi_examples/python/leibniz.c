@@ -0,0 +1,32 @@
+/*
+ * Leibniz series slice kernel for mpipypi.py:
+ *
+ *   gcc -O3 -fopenmp -shared -fPIC -o libleibniz.so leibniz.c
+ *
+ * OMP_NUM_THREADS sets the threads each MPI rank uses for a slice.
+ */
+
+/*
+ * Sum of (-1)^i / (2i+1) for first <= i < first + count.  The terms are
+ * taken in pairs, 1/(2i+1) - 1/(2i+3), so the loop has no sign test and
+ * vectorizes; the sign of the whole sum is that of the first term.
+ */
+double leibniz_slice(long first, long count)
+{
+    long npairs = count / 2, k;
+    double sum = 0.0;
+
+#pragma omp parallel for simd schedule(static) reduction(+:sum)
+    for (k = 0; k < npairs; ++k) {
+        double i = first + 2.0 * k;
+        sum += 1.0 / (2.0 * i + 1.0) - 1.0 / (2.0 * i + 3.0);
+    }
+    if (first % 2 != 0) {
+        sum = -sum;
+    }
+    if (count % 2 != 0) {
+        long i = first + count - 1;
+        sum += (i % 2 == 0 ? 1.0 : -1.0) / (2.0 * i + 1.0);
+    }
+    return sum;
+}
@@ -1,7 +1,19 @@
 """
 mpirun -np <N> python mpipypi.py
-""" 
 
+Each slice is summed by leibniz_slice() in libleibniz.so, if it has been
+built next to this script with
+
+    gcc -O3 -fopenmp -shared -fPIC -o libleibniz.so leibniz.c
+
+(OMP_NUM_THREADS then sets the threads per rank), or with NumPy if not.
+Messages are typed NumPy buffers sent with Send/Recv, not pickled objects.
+"""
+
+import ctypes
+import os
+
+import numpy as np
 from mpi4py import MPI
 
 comm = MPI.COMM_WORLD
@@ -11,6 +23,41 @@ size = comm.Get_size()
 slice_size = 1000000
 total_slices = 50
 
+
+def load_slice_kernel():
+    """leibniz_slice(first, count) from libleibniz.so, or None."""
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        "libleibniz.so")
+    try:
+        lib = ctypes.CDLL(path)
+    except OSError:
+        return None
+    lib.leibniz_slice.restype = ctypes.c_double
+    lib.leibniz_slice.argtypes = [ctypes.c_long, ctypes.c_long]
+    return lib.leibniz_slice
+
+
+def numpy_slice(first, count):
+    """Sum of (-1)^i/(2i+1), first <= i < first+count, in pairs of terms."""
+    i = first + 2.0 * np.arange(count // 2)
+    value = np.sum(1.0 / (2.0 * i + 1.0) - 1.0 / (2.0 * i + 3.0))
+    if first % 2 != 0:
+        value = -value
+    if count % 2 != 0:
+        last = first + count - 1
+        value += (1.0 if last % 2 == 0 else -1.0) / (2.0 * last + 1.0)
+    return float(value)
+
+
+slice_kernel = load_slice_kernel()
+if slice_kernel is None:
+    slice_kernel = numpy_slice
+
+# Message buffers: a slice number (-1 to stop), and a result packed with
+# the rank that computed it.
+task = np.empty(1, dtype=np.int64)
+result = np.empty(2, dtype=np.float64)
+
 # This is the master node.
 if rank == 0:
     pi = 0
@@ -18,10 +65,13 @@ if rank == 0:
     process = 1
 
     print (str(size))
+    print ("Slice kernel: " + ("NumPy" if slice_kernel is numpy_slice
+                               else "libleibniz.so"))
 
     # Send the first batch of processes to the nodes.
     while process < size and slice < total_slices:
-        comm.send(slice, dest=process, tag=1)
+        task[0] = slice
+        comm.Send(task, dest=process, tag=1)
         print ("Sending slice "+str(slice)+" to process "+str(process))
         slice += 1
         process += 1
@@ -29,37 +79,32 @@ if rank == 0:
     # Wait for the data to come back
     received_processes = 0
     while received_processes < total_slices:
-        pi += comm.recv(source=MPI.ANY_SOURCE, tag=1)
-        process = comm.recv(source=MPI.ANY_SOURCE, tag=2)
+        comm.Recv(result, source=MPI.ANY_SOURCE, tag=1)
+        pi += result[0]
+        process = int(result[1])
         print ("Recieved data from process "+str(process))
         received_processes += 1
 
         if slice < total_slices:
-            comm.send(slice, dest=process, tag=1)
+            task[0] = slice
+            comm.Send(task, dest=process, tag=1)
             print ("Sending slice "+str(slice)+" to process "+str(process))
             slice += 1
 
     # Send the shutdown signal
+    task[0] = -1
     for process in range(1,size):
-        comm.send(-1, dest=process, tag=1)
+        comm.Send(task, dest=process, tag=1)
 
     print("Pi is "+str(4.0 * pi))
 
 # These are the slave nodes, where rank > 0. They do the real work
 else:
     while True:
-        start = comm.recv(source=0, tag=1)
+        comm.Recv(task, source=0, tag=1)
+        start = int(task[0])
         if start == -1: break
 
-        i = 0
-        slice_value = 0
-        while i < slice_size:
-            if i%2 == 0:
-                slice_value += 1.0 / (2*(start*slice_size+i)+1)
-            else:
-                slice_value -= 1.0 / (2*(start*slice_size+i)+1)
-            i += 1
-
-        comm.send(slice_value, dest=0, tag=1)
-        comm.send(rank, dest=0, tag=2)
-
+        result[0] = slice_kernel(start*slice_size, slice_size)
+        result[1] = rank
+        comm.Send(result, dest=0, tag=1)
@@ -0,0 +1,328 @@
+/*
+ * The background file writer of async_io.h.
+ *
+ *   gcc -O3 -fopenmp -c async_io.c
+ *   gfortran -O3 -fopenmp -o md_f90 md_openmp.f90 async_io.o -lpthread
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <omp.h>
+#include "async_io.h"
+
+#define BUFFERS 2
+#define PATH_LEN 4096
+
+/* Bytes per pwrite() call, and per thread in the parallel copy. */
+#define WRITE_CHUNK (8L << 20)
+#define COPY_CHUNK (1L << 20)
+
+enum slot_state { FREE, FILLING, QUEUED, WRITING };
+
+typedef struct {
+    enum slot_state state;
+    long seq;                   /* commit order */
+    char path[PATH_LEN];
+    int append;                 /* add to PATH instead of replacing it */
+    char *data;
+    size_t size, capacity;
+} slot;
+
+struct async_io {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    slot slots[BUFFERS];
+    int filling;                /* the slot between begin and commit */
+    long next_seq;
+    int stop;
+    async_io_filter filter;
+    void *filter_arg;
+    async_io_stats stats;
+};
+
+/* Write SIZE bytes of DATA to PATH.tmp, then rename it to PATH. */
+static int write_file(const char *path, const char *data, size_t size)
+{
+    char tmp[PATH_LEN + 8];
+    size_t done = 0;
+    ssize_t n;
+    int fd;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        fprintf(stderr, "async_io: cannot open %s: %s\n", tmp,
+                strerror(errno));
+        return -1;
+    }
+    while (done < size) {
+        size_t len = size - done < WRITE_CHUNK ? size - done : WRITE_CHUNK;
+
+        n = pwrite(fd, data + done, len, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "async_io: cannot write %s: %s\n", tmp,
+                    strerror(errno));
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    if (fsync(fd) != 0 || close(fd) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "async_io: cannot finish %s: %s\n", path,
+                strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Append SIZE bytes of DATA to PATH, creating it if need be. */
+static int append_file(const char *path, const char *data, size_t size)
+{
+    size_t done = 0;
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0) {
+        fprintf(stderr, "async_io: cannot open %s: %s\n", path,
+                strerror(errno));
+        return -1;
+    }
+    while (done < size) {
+        size_t len = size - done < WRITE_CHUNK ? size - done : WRITE_CHUNK;
+
+        n = write(fd, data + done, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "async_io: cannot write %s: %s\n", path,
+                    strerror(errno));
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    if (close(fd) != 0) {
+        fprintf(stderr, "async_io: cannot finish %s: %s\n", path,
+                strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* The writer thread: write the queued slots in commit order. */
+static void *writer(void *arg)
+{
+    async_io *io = arg;
+    const char *data;
+    size_t size;
+    slot *s;
+    double t;
+    int k, ok;
+
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        s = NULL;
+        for (k = 0; k < BUFFERS; ++k) {
+            if (io->slots[k].state == QUEUED
+                && (s == NULL || io->slots[k].seq < s->seq)) {
+                s = &io->slots[k];
+            }
+        }
+        if (s == NULL) {
+            if (io->stop) {
+                break;
+            }
+            pthread_cond_wait(&io->changed, &io->lock);
+            continue;
+        }
+        s->state = WRITING;
+        pthread_mutex_unlock(&io->lock);
+
+        data = s->data;
+        size = s->size;
+        if (io->filter != NULL) {
+            size = io->filter(io->filter_arg, s->data, s->size, &data);
+        }
+
+        t = omp_get_wtime();
+        if (s->append) {
+            ok = append_file(s->path, data, size) == 0;
+        } else {
+            ok = write_file(s->path, data, size) == 0;
+        }
+        t = omp_get_wtime() - t;
+
+        pthread_mutex_lock(&io->lock);
+        if (ok) {
+            io->stats.files += 1;
+            io->stats.bytes += size;
+        } else {
+            io->stats.errors += 1;
+        }
+        io->stats.write_seconds += t;
+        s->state = FREE;
+        pthread_cond_broadcast(&io->changed);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+async_io *async_io_create(void)
+{
+    async_io *io = calloc(1, sizeof(async_io));
+
+    if (io == NULL) {
+        fprintf(stderr, "async_io: out of memory\n");
+        exit(1);
+    }
+    io->filling = -1;
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->changed, NULL);
+    if (pthread_create(&io->thread, NULL, writer, io) != 0) {
+        fprintf(stderr, "async_io: cannot start the writer thread\n");
+        exit(1);
+    }
+    return io;
+}
+
+void async_io_set_filter(async_io *io, async_io_filter filter, void *arg)
+{
+    async_io_wait(io);
+    pthread_mutex_lock(&io->lock);
+    io->filter = filter;
+    io->filter_arg = arg;
+    pthread_mutex_unlock(&io->lock);
+}
+
+static void begin(async_io *io, const char *path, int append)
+{
+    double t = omp_get_wtime();
+    int k;
+
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        for (k = 0; k < BUFFERS && io->slots[k].state != FREE; ++k) {
+        }
+        if (k < BUFFERS) {
+            break;
+        }
+        pthread_cond_wait(&io->changed, &io->lock);
+    }
+    io->slots[k].state = FILLING;
+    io->stats.stall_seconds += omp_get_wtime() - t;
+    pthread_mutex_unlock(&io->lock);
+
+    io->filling = k;
+    strncpy(io->slots[k].path, path, PATH_LEN - 1);
+    io->slots[k].path[PATH_LEN - 1] = '\0';
+    io->slots[k].append = append;
+    io->slots[k].size = 0;
+}
+
+void async_io_begin(async_io *io, const char *path)
+{
+    begin(io, path, 0);
+}
+
+void async_io_begin_append(async_io *io, const char *path)
+{
+    begin(io, path, 1);
+}
+
+void async_io_append(async_io *io, const void *data, size_t bytes)
+{
+    slot *s = &io->slots[io->filling];
+    const char *from = data;
+    long chunks, c;
+    char *to;
+
+    if (s->size + bytes > s->capacity) {
+        size_t capacity = s->capacity + s->capacity / 2;
+
+        if (capacity < s->size + bytes) {
+            capacity = s->size + bytes;
+        }
+        if ((s->data = realloc(s->data, capacity)) == NULL) {
+            fprintf(stderr, "async_io: out of memory\n");
+            exit(1);
+        }
+        s->capacity = capacity;
+    }
+
+    /* Large copies are shared by the threads, as memory bandwidth is. */
+    to = s->data + s->size;
+    chunks = (bytes + COPY_CHUNK - 1) / COPY_CHUNK;
+#pragma omp parallel for schedule(static) if (chunks > 1 && !omp_in_parallel())
+    for (c = 0; c < chunks; ++c) {
+        size_t first = c * COPY_CHUNK;
+        size_t len = bytes - first < COPY_CHUNK ? bytes - first : COPY_CHUNK;
+
+        memcpy(to + first, from + first, len);
+    }
+    s->size += bytes;
+}
+
+void async_io_commit(async_io *io)
+{
+    pthread_mutex_lock(&io->lock);
+    io->slots[io->filling].state = QUEUED;
+    io->slots[io->filling].seq = io->next_seq++;
+    io->filling = -1;
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+}
+
+int async_io_wait(async_io *io)
+{
+    int k, busy, errors;
+
+    pthread_mutex_lock(&io->lock);
+    do {
+        busy = 0;
+        for (k = 0; k < BUFFERS; ++k) {
+            busy |= io->slots[k].state == QUEUED
+                || io->slots[k].state == WRITING;
+        }
+        if (busy) {
+            pthread_cond_wait(&io->changed, &io->lock);
+        }
+    } while (busy);
+    errors = io->stats.errors;
+    pthread_mutex_unlock(&io->lock);
+    return errors;
+}
+
+void async_io_get_stats(async_io *io, async_io_stats *stats)
+{
+    pthread_mutex_lock(&io->lock);
+    *stats = io->stats;
+    pthread_mutex_unlock(&io->lock);
+}
+
+void async_io_destroy(async_io *io)
+{
+    int k;
+
+    async_io_wait(io);
+    pthread_mutex_lock(&io->lock);
+    io->stop = 1;
+    pthread_cond_broadcast(&io->changed);
+    pthread_mutex_unlock(&io->lock);
+    pthread_join(io->thread, NULL);
+
+    for (k = 0; k < BUFFERS; ++k) {
+        free(io->slots[k].data);
+    }
+    pthread_cond_destroy(&io->changed);
+    pthread_mutex_destroy(&io->lock);
+    free(io);
+}
@@ -0,0 +1,74 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stddef.h>
+
+/*
+ * Whole files written by a background thread, so that a solver can save
+ * its state and go on computing while the data goes to disk.
+ *
+ * The writer has two buffers.  A file is described by async_io_begin(),
+ * one or more async_io_append() calls, which copy the data into a free
+ * buffer (with all OpenMP threads, if called outside a parallel region),
+ * and async_io_commit(), which hands the buffer to the writer thread and
+ * returns at once.  The solver can then fill the second buffer while the
+ * first is written; async_io_begin() only waits if both are still busy.
+ *
+ * The writer puts the data in PATH.tmp with pwrite(), syncs it, and
+ * renames it to PATH, so PATH always holds the last complete file, even
+ * if the program is killed during a write.
+ *
+ * async_io_begin_append() instead adds the data to the end of PATH, for
+ * a stream of records such as a trajectory.  These writes are not synced.
+ *
+ * A filter, if set, is called by the writer thread with each file's data
+ * before it is written, in commit order, and returns the bytes to write
+ * instead.  Encoding and compression can so be kept off the solver's
+ * thread, and a filter may keep state from one file to the next.
+ *
+ * The functions are meant to be called from Fortran through BIND(C)
+ * interfaces, and from one thread at a time.
+ */
+typedef struct async_io async_io;
+
+typedef struct {
+    double files;               /* files written */
+    double bytes;               /* bytes written */
+    double write_seconds;       /* time the writer thread spent writing */
+    double stall_seconds;       /* time async_io_begin() waited */
+    double errors;              /* files that could not be written */
+} async_io_stats;
+
+/*
+ * Return the number of bytes to write for the SIZE bytes of DATA, and
+ * set *OUT to them; *OUT must stay valid until the next call.
+ */
+typedef size_t (*async_io_filter)(void *arg, const char *data, size_t size,
+                                  const char **out);
+
+async_io *async_io_create(void);
+
+/* Start a file that will be written to PATH; waits for a free buffer. */
+void async_io_begin(async_io *io, const char *path);
+
+/* The same, for data to be appended to PATH. */
+void async_io_begin_append(async_io *io, const char *path);
+
+/* Copy BYTES bytes from DATA to the end of the file being built. */
+void async_io_append(async_io *io, const void *data, size_t bytes);
+
+/* Queue the file for writing. */
+void async_io_commit(async_io *io);
+
+/* Pass all later files through FILTER; waits for earlier ones. */
+void async_io_set_filter(async_io *io, async_io_filter filter, void *arg);
+
+/* Wait until every committed file is written; return the error count. */
+int async_io_wait(async_io *io);
+
+void async_io_get_stats(async_io *io, async_io_stats *stats);
+
+/* Wait for the writes, stop the writer thread and free IO. */
+void async_io_destroy(async_io *io);
+
+#endif
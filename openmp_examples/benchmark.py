@@ -0,0 +1,287 @@
+#!/usr/bin/env python
+"""
+Benchmark driver for the workshop kernels.
+
+Runs the pi, heated plate, molecular dynamics and MPI pi programs over
+sweeps of thread counts, MPI ranks and problem sizes, repeating each run,
+and reports the best and median times, speedup and parallel efficiency
+relative to the smallest thread (or rank) count, and a throughput rate.
+Results are written as CSV and/or JSON, and can be compared against an
+earlier JSON file to catch scaling regressions.
+
+Build the programs first with make_gcc_exe.sh, then for example:
+
+    python benchmark.py --threads 1,2,4,8,16,20 --trials 3 --csv bench.csv
+    python benchmark.py --kernels plate --plate-sizes 600,2000 \\
+        --plate-args solver=fused --json bench.json
+    python benchmark.py --baseline bench.json --tolerance 0.10
+
+Threads are pinned with OMP_PLACES/OMP_PROC_BIND (see --places, --bind),
+and MPI runs use --mpirun and --mpirun-args.
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+MPI_DIR = os.path.join(HERE, os.pardir, "mpi_examples", "fortran_c_codes")
+
+# Each kernel has a program, the option that sets its size, the regular
+# expression for the time the program reports itself (if any), and a
+# function giving the amount of work done, and its unit, from the size,
+# the extra options and the program output.
+
+
+def pi_work(size, args, out):
+    # x = (i+0.5)*step; sum += 4/(1+x*x): 2 adds, 2 multiplies, 1 divide
+    # and 1 add per term.
+    return 6.0 * size / 1.0e9, "GFLOP/s"
+
+
+def plate_work(size, args, out):
+    m = n = size
+    found = re.findall(r"^\s+(\d+)\s+\S+\s*$", out, re.M)
+    iterations = int(found[-1]) if found else 0
+    # Nominal memory traffic per node and iteration: the default Jacobi
+    # loop reads and writes the grid in three passes, the other solvers
+    # read one array and write one.
+    solver = args.get("solver", "jacobi")
+    passes = 3 if solver == "jacobi" else 1
+    return 16.0 * passes * m * n * iterations / 1.0e9, "GB/s"
+
+
+def md_work(size, args, out):
+    steps = int(args.get("step_num", 400))
+    return size * steps / 1.0e6, "Mparticle-steps/s"
+
+
+def pi_mpi_work(size, args, out):
+    return 6.0 * size / 1.0e9, "GFLOP/s"
+
+
+KERNELS = {
+    "pi": {
+        "program": os.path.join(HERE, "pi_red"),
+        "size_option": "steps",
+        "default_sizes": [5000000000],
+        "time_re": None,
+        "work": pi_work,
+        "mpi": False,
+    },
+    "plate": {
+        "program": os.path.join(HERE, "heated_plate_f90"),
+        "size_option": "m",
+        "default_sizes": [600],
+        "time_re": r"Wall clock time =\s*(\S+)",
+        "work": plate_work,
+        "mpi": False,
+    },
+    "md": {
+        "program": os.path.join(HERE, "md_f90"),
+        "size_option": "np",
+        "default_sizes": [1000],
+        "time_re": r"Elapsed time for main computation:\s*(\S+)",
+        "work": md_work,
+        "mpi": False,
+    },
+    "pi_mpi": {
+        "program": os.path.join(MPI_DIR, "pi_mpi", "pi_mpi"),
+        "size_option": "n",
+        "default_sizes": [900000000],
+        "time_re": None,
+        "work": pi_mpi_work,
+        "mpi": True,
+    },
+}
+
+
+def int_list(text):
+    return [int(x) for x in text.split(",") if x]
+
+
+def parse_options(text):
+    """Turn 'a=1 b=2' into a dict."""
+    options = {}
+    for item in text.split():
+        key, _, value = item.partition("=")
+        options[key] = value
+    return options
+
+
+def run_once(command, env):
+    start = time.perf_counter()
+    proc = subprocess.run(command, env=env, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, universal_newlines=True)
+    elapsed = time.perf_counter() - start
+    if proc.returncode != 0:
+        sys.stderr.write(proc.stdout)
+        raise RuntimeError("command failed: " + " ".join(command))
+    return elapsed, proc.stdout
+
+
+def run_kernel(name, kernel, size, threads, ranks, extra, opts):
+    args = dict(extra)
+    args[kernel["size_option"]] = str(size)
+    if name == "plate":
+        args.setdefault("n", str(size))
+    command = [kernel["program"]] + ["%s=%s" % kv for kv in args.items()]
+    if kernel["mpi"]:
+        command = ([opts.mpirun, "-np", str(ranks)]
+                   + opts.mpirun_args.split() + command)
+
+    env = dict(os.environ)
+    env["OMP_NUM_THREADS"] = str(threads)
+    env["OMP_DYNAMIC"] = "FALSE"
+    if opts.places:
+        env["OMP_PLACES"] = opts.places
+    if opts.bind:
+        env["OMP_PROC_BIND"] = opts.bind
+
+    times = []
+    out = ""
+    for _ in range(opts.trials):
+        elapsed, out = run_once(command, env)
+        if kernel["time_re"]:
+            found = re.search(kernel["time_re"], out)
+            if found:
+                elapsed = float(found.group(1))
+        times.append(elapsed)
+
+    work, unit = kernel["work"](size, args, out)
+    best = min(times)
+    return {
+        "kernel": name,
+        "size": size,
+        "threads": threads,
+        "ranks": ranks,
+        "options": " ".join("%s=%s" % kv for kv in extra.items()),
+        "trials": len(times),
+        "best_s": best,
+        "median_s": statistics.median(times),
+        "rate": work / best if best > 0 else 0.0,
+        "rate_unit": unit,
+    }
+
+
+def add_scaling(results):
+    """Speedup and efficiency relative to the fewest processors, per size."""
+    groups = {}
+    for r in results:
+        key = (r["kernel"], r["size"], r["options"])
+        groups.setdefault(key, []).append(r)
+    for group in groups.values():
+        base = min(group, key=lambda r: r["threads"] * r["ranks"])
+        base_procs = base["threads"] * base["ranks"]
+        for r in group:
+            procs = r["threads"] * r["ranks"]
+            r["speedup"] = base["best_s"] / r["best_s"]
+            r["efficiency"] = r["speedup"] * base_procs / procs
+
+
+def compare(results, baseline_file, tolerance):
+    """Return the runs that are slower than the baseline by > tolerance."""
+    with open(baseline_file) as f:
+        baseline = json.load(f)
+    old = {}
+    for r in baseline:
+        old[(r["kernel"], r["size"], r["threads"], r["ranks"],
+             r["options"])] = r
+    slower = []
+    for r in results:
+        key = (r["kernel"], r["size"], r["threads"], r["ranks"], r["options"])
+        if key in old and r["best_s"] > (1.0 + tolerance) * old[key]["best_s"]:
+            slower.append((r, old[key]))
+    return slower
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+    parser.add_argument("--kernels", default="pi,plate,md,pi_mpi",
+                        help="comma separated list of " + ",".join(KERNELS))
+    parser.add_argument("--threads", type=int_list, default=[1, 2, 4, 8, 16, 20],
+                        help="OpenMP thread counts")
+    parser.add_argument("--ranks", type=int_list, default=[1, 2, 4],
+                        help="MPI rank counts, for pi_mpi")
+    parser.add_argument("--trials", type=int, default=3,
+                        help="runs of each configuration")
+    for name, kernel in KERNELS.items():
+        parser.add_argument("--%s-sizes" % name.replace("_", "-"),
+                            type=int_list, default=kernel["default_sizes"],
+                            help="values of %s" % kernel["size_option"])
+        parser.add_argument("--%s-args" % name.replace("_", "-"), default="",
+                            help="extra NAME=VALUE options")
+    parser.add_argument("--places", default="cores",
+                        help="OMP_PLACES, empty to leave unset")
+    parser.add_argument("--bind", default="close",
+                        help="OMP_PROC_BIND, empty to leave unset")
+    parser.add_argument("--mpirun", default="mpirun")
+    parser.add_argument("--mpirun-args", default="--bind-to core")
+    parser.add_argument("--csv", help="write results to this CSV file")
+    parser.add_argument("--json", help="write results to this JSON file")
+    parser.add_argument("--baseline",
+                        help="JSON results to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="allowed slowdown against the baseline")
+    opts = parser.parse_args()
+
+    results = []
+    for name in opts.kernels.split(","):
+        if name not in KERNELS:
+            parser.error("unknown kernel " + name)
+        kernel = KERNELS[name]
+        attr = name.replace("-", "_")
+        sizes = getattr(opts, attr + "_sizes")
+        extra = parse_options(getattr(opts, attr + "_args"))
+        if kernel["mpi"]:
+            configs = [(1, r) for r in opts.ranks]
+        else:
+            configs = [(t, 1) for t in opts.threads]
+        for size in sizes:
+            for threads, ranks in configs:
+                r = run_kernel(name, kernel, size, threads, ranks, extra, opts)
+                results.append(r)
+                sys.stdout.write(
+                    "%-7s size=%-11d threads=%-3d ranks=%-3d best=%10.4fs "
+                    "%10.4g %s\n" % (name, size, threads, ranks, r["best_s"],
+                                     r["rate"], r["rate_unit"]))
+                sys.stdout.flush()
+
+    add_scaling(results)
+
+    sys.stdout.write("\n%-7s %12s %4s %4s %10s %8s %6s\n" % (
+        "kernel", "size", "thr", "rank", "best_s", "speedup", "eff"))
+    for r in results:
+        sys.stdout.write("%-7s %12d %4d %4d %10.4f %8.2f %6.2f\n" % (
+            r["kernel"], r["size"], r["threads"], r["ranks"], r["best_s"],
+            r["speedup"], r["efficiency"]))
+
+    if opts.csv:
+        with open(opts.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=list(results[0].keys()))
+            writer.writeheader()
+            writer.writerows(results)
+    if opts.json:
+        with open(opts.json, "w") as f:
+            json.dump(results, f, indent=1)
+
+    if opts.baseline:
+        slower = compare(results, opts.baseline, opts.tolerance)
+        for r, old in slower:
+            sys.stdout.write(
+                "REGRESSION %s size=%d threads=%d ranks=%d: %.4fs, was %.4fs\n"
+                % (r["kernel"], r["size"], r["threads"], r["ranks"],
+                   r["best_s"], old["best_s"]))
+        if slower:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
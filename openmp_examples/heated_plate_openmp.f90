@@ -1,3 +1,44 @@
+module omp_regions
+
+!*****************************************************************************80
+!
+!! OMP_REGIONS declares the OpenMP region timers of omp_regions.c.
+!
+!  Discussion:
+!
+!    See omp_regions.h for how a parallel region and its loops are
+!    marked.  The names are C strings, as in 'jacobi' // c_null_char.
+!
+  use iso_c_binding
+
+  implicit none
+
+  interface
+    subroutine region_fork ( name ) bind ( c )
+      import c_char
+      character ( kind = c_char ) name(*)
+    end subroutine region_fork
+    subroutine region_join ( ) bind ( c )
+    end subroutine region_join
+    subroutine region_start ( ) bind ( c )
+    end subroutine region_start
+    subroutine region_wait ( name ) bind ( c )
+      import c_char
+      character ( kind = c_char ) name(*)
+    end subroutine region_wait
+    subroutine region_work ( name ) bind ( c )
+      import c_char
+      character ( kind = c_char ) name(*)
+    end subroutine region_work
+    subroutine regions_init ( enabled ) bind ( c )
+      import c_int
+      integer ( kind = c_int ), value :: enabled
+    end subroutine regions_init
+    subroutine regions_report ( ) bind ( c )
+    end subroutine regions_report
+  end interface
+
+end module omp_regions
 program main
 
 !*****************************************************************************80
@@ -55,8 +96,114 @@ program main
 !    successive estimates of the solution will go to zero.
 !
 !    This program carries out such an iteration, using a tolerance specified by
-!    the user, and writes the final estimate of the solution to a file that can
-!    be used for graphic processing.
+!    the user, and can write the final estimate of the solution to a file that
+!    can be used for graphic processing.
+!
+!    The size of the grid, M by N, the tolerance EPS, and the solver and
+!    its parameters may be set on the command line, as in
+!
+!      heated_plate_f90 m=2000 n=1000 eps=0.0001 solver=sor
+!
+!    or by the environment variables PLATE_M, PLATE_N, PLATE_EPS,
+!    PLATE_SOLVER, and so on.  The command line takes precedence.
+!
+!    The option SOLVER selects how the iteration is done:
+!
+!      JACOBI, the default, copies W into U, updates W from U, and then
+!      compares U and W, making three passes over the grid per iteration;
+!
+!      FUSED makes one pass per iteration.  U and W swap roles at every
+!      iteration, so that no copy is needed, and the change is computed
+!      as each node is updated.  The iterates are the same as for JACOBI.
+!
+!      TILED is FUSED with temporal blocking.  The grid is cut into tiles
+!      of TILE_M by TILE_N nodes (default 128 by 128), and each tile, with
+!      a halo of TILE_STEPS nodes (default 8), is copied into a small buffer
+!      that stays in cache while TILE_STEPS iterations are carried out on
+!      it.  The change is only checked after the last of these iterations,
+!      so the iteration count is a multiple of TILE_STEPS.
+!
+!      PERSISTENT is FUSED in a single parallel region for the whole
+!      solve, with one barrier per iteration and none of the team start
+!      and end of the other solvers.  The change is only computed every
+!      CHECK iterations; the default, CHECK=0, adapts the interval to the
+!      rate of convergence, so that few iterations are done past EPS.
+!      The change, and the progress report, checkpoints and snapshots,
+!      are only available at these checks.  After a restart, the adaptive
+!      interval starts again, so the run may stop a few iterations apart
+!      from an uninterrupted one.
+!
+!      RBGS is red-black Gauss-Seidel.  The nodes are colored like a
+!      checkerboard, and all red nodes, then all black nodes, are updated
+!      in place.  Each node of one color only depends on nodes of the other
+!      color, so each half sweep is parallel.
+!
+!      SOR is RBGS with successive over-relaxation: each node moves OMEGA
+!      times as far as Gauss-Seidel would move it.  OMEGA may be set as an
+!      option.  By default it is the optimal value for the Laplace
+!      equation on this grid,
+!
+!        OMEGA = 2 / ( 1 + sqrt ( 1 - RHO^2 ) ),
+!
+!      where RHO = ( cos ( PI / ( M - 1 ) ) + cos ( PI / ( N - 1 ) ) ) / 2
+!      is the convergence factor of the Jacobi iteration.
+!
+!      MULTIGRID carries out geometric multigrid V-cycles.  The error
+!      left by a few red-black Gauss-Seidel sweeps is smooth, so it is
+!      computed on a grid with about half as many nodes in each direction,
+!      and so on recursively, down to a grid of a few nodes.  Each V-cycle
+!      costs a few sweeps of the fine grid, and reduces the error by a
+!      factor that does not depend on the size of the grid.
+!
+!    For all solvers but MULTIGRID, an iteration is one update of every
+!    node; for MULTIGRID it is one V-cycle.  DIFF is the largest change of
+!    a node in the iteration.
+!
+!    U, W and the multigrid work array are first written by the same
+!    static partition of the columns over the threads that the solvers
+!    use, so that on a NUMA system each thread's columns live in its own
+!    node's memory.  NUMA_REPORT=yes prints how the process memory is
+!    spread over the NUMA nodes at the end of the run.
+!
+!    CHECKPOINT=K saves the state of the iteration to CHECKPOINT_FILE
+!    (default plate.ckpt) every K iterations, and RESTART=yes resumes from
+!    that file.  The checkpoint is raw binary: eight 64 bit integers, the
+!    magic number "PLATECKP", M, N, the iteration count, the next
+!    iteration to print, the first 16 characters of the solver name and a
+!    0; then DIFF; then the latest solution, M by N.
+!    The solution is copied into a buffer, and a background thread (see
+!    async_io.c) writes it while the iteration goes on.  The resumed run
+!    carries out exactly the same arithmetic as an uninterrupted one.
+!
+!    OUTPUT=FILE writes the final solution to FILE, and SNAPSHOT=K also
+!    writes the solution every K iterations, to FILE.NNNNNNNN, NNNNNNNN
+!    being the iteration count.  Each file starts with a 4096 byte text
+!    header of "name value" lines, padded with blanks, saying what
+!    follows it:
+!
+!      HEATED_PLATE_OUTPUT 1
+!      m 600
+!      n 600
+!      iterations 1234
+!      diff 0.999977E-03
+!      type float64
+!      byte_order little
+!      order fortran
+!      offset 4096
+!
+!    and then the M by N solution, raw, with I varying fastest, so that
+!    the file can be mapped, for instance with numpy.memmap ( file,
+!    dtype = '<f8', offset = 4096, shape = ( m, n ), order = 'F' ).  The
+!    solution is copied into a buffer, and a background thread writes it,
+!    so that the solver never waits for the disk unless both buffers are
+!    still being written.  The report gives the write bandwidth, and the
+!    time the solver stalled, against the compute time.
+!
+!    PROFILE=yes times each parallel region of the solvers, and each loop
+!    in it, on every thread, with the markers of omp_regions.c, and
+!    prints at the end how long the threads were busy, how unevenly, how
+!    long they waited at the barrier ending each loop, and how long the
+!    team took to start and end.
 !
 !  Licensing:
 !
@@ -92,26 +239,105 @@ program main
 !    Local, real ( kind = 8 ) W(M,N), the solution computed at the latest 
 !    iteration.
 !
+  use iso_c_binding
   use omp_lib
+  use omp_regions
 
   implicit none
 
-  integer ( kind = 4 ), parameter :: m = 600
-  integer ( kind = 4 ), parameter :: n = 600
+  interface
+    function async_io_create ( ) bind ( c )
+      import c_ptr
+      type ( c_ptr ) async_io_create
+    end function async_io_create
+    subroutine async_io_begin ( io, path ) bind ( c )
+      import c_char, c_ptr
+      type ( c_ptr ), value :: io
+      character ( kind = c_char ) path(*)
+    end subroutine async_io_begin
+    subroutine async_io_append ( io, data, bytes ) bind ( c )
+      import c_ptr, c_size_t
+      type ( c_ptr ), value :: io
+      type ( * ) data(*)
+      integer ( kind = c_size_t ), value :: bytes
+    end subroutine async_io_append
+    subroutine async_io_commit ( io ) bind ( c )
+      import c_ptr
+      type ( c_ptr ), value :: io
+    end subroutine async_io_commit
+    function async_io_wait ( io ) bind ( c )
+      import c_int, c_ptr
+      type ( c_ptr ), value :: io
+      integer ( kind = c_int ) async_io_wait
+    end function async_io_wait
+    subroutine async_io_get_stats ( io, stats ) bind ( c )
+      import c_double, c_ptr
+      type ( c_ptr ), value :: io
+      real ( kind = c_double ) stats(5)
+    end subroutine async_io_get_stats
+    subroutine async_io_destroy ( io ) bind ( c )
+      import c_ptr
+      type ( c_ptr ), value :: io
+    end subroutine async_io_destroy
+  end interface
 
+  integer ( kind = 4 ) :: check = 0
+  integer ( kind = 4 ) :: checkpoint = 0
+  character ( len = 255 ) checkpoint_file
+  type ( c_ptr ) checkpoint_io
+  real ( kind = 8 ) checkpoint_stats(5)
   real ( kind = 8 ) diff
   real ( kind = 8 ) :: eps = 0.001D+00
   integer ( kind = 4 ) i
+  integer ( kind = 4 ) ios
   integer ( kind = 4 ) iterations
   integer ( kind = 4 ) iterations_print
   integer ( kind = 4 ) j
+  integer ( kind = 4 ) k
+  integer ( kind = 4 ) :: m = 600
   real ( kind = 8 ) mean
-  real ( kind = 8 ) u(m,n)
-  real ( kind = 8 ) w(m,n)
+  integer ( kind = 4 ) mg_levels
+  integer ( kind = 4 ) mg_work_size
+  real ( kind = 8 ), allocatable :: mg_work(:)
+  integer ( kind = 4 ) :: n = 600
+  character ( len = 255 ) numa_mode
+  real ( kind = 8 ) omega
+  character ( len = 255 ) output
+  type ( c_ptr ) output_io
+  real ( kind = 8 ) output_stats(5)
+  real ( kind = 8 ) output_wait
+  character ( len = 264 ) path
+  real ( kind = 8 ), parameter :: pi = 3.141592653589793D+00
+  character ( len = 255 ) profile
+  character ( len = 255 ) restart
+  real ( kind = 8 ) rho
+  integer ( kind = 4 ) :: snapshot = 0
+  character ( len = 255 ) solver
+  integer ( kind = 4 ) steps
+  logical swapped
+  integer ( kind = 4 ) :: tile_m = 128
+  integer ( kind = 4 ) :: tile_n = 128
+  integer ( kind = 4 ) :: tile_steps = 8
+  real ( kind = 8 ), allocatable :: u(:,:)
+  real ( kind = 8 ), allocatable :: w(:,:)
   real ( kind = 8 ) wtime
   real ( kind = 8 ) Dutch_wind_eta
   character(len=255) :: cpuaffinity
 
+  call option_get_i4 ( 'm', 'PLATE_M', m )
+  call option_get_i4 ( 'n', 'PLATE_N', n )
+  call option_get_r8 ( 'eps', 'PLATE_EPS', eps )
+
+  if ( m < 3 .or. n < 3 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'HEATED_PLATE_OPENMP - Fatal error!'
+    write ( *, '(a)' ) '  M and N must be at least 3.'
+    stop 1
+  end if
+
+  allocate ( u(m,n) )
+  allocate ( w(m,n) )
+
   write ( *, '(a)' ) ' '
   write ( *, '(a)' ) 'HEATED_PLATE_OPENMP'
   write ( *, '(a)' ) '  FORTRAN90 version'
@@ -127,10 +353,127 @@ program main
   write ( *, '(a,i8)' ) &
     '  The number of threads available    = ', omp_get_max_threads ( )
 
+  solver = 'jacobi'
+  call option_get ( 'solver', 'PLATE_SOLVER', solver )
+  if ( solver /= 'jacobi' .and. solver /= 'fused' .and. &
+    solver /= 'tiled' .and. solver /= 'rbgs' .and. solver /= 'sor' .and. &
+    solver /= 'multigrid' .and. solver /= 'persistent' ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'HEATED_PLATE_OPENMP - Fatal error!'
+    write ( *, '(a,a)' ) '  Unknown SOLVER = ', trim ( solver )
+    stop 1
+  end if
+  write ( *, '(a,a)' ) '  The solver is ', trim ( solver )
+
+  if ( solver == 'tiled' ) then
+    call option_get_i4 ( 'tile_m', 'PLATE_TILE_M', tile_m )
+    call option_get_i4 ( 'tile_n', 'PLATE_TILE_N', tile_n )
+    call option_get_i4 ( 'tile_steps', 'PLATE_TILE_STEPS', tile_steps )
+    if ( tile_m < 1 .or. tile_n < 1 .or. tile_steps < 1 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'HEATED_PLATE_OPENMP - Fatal error!'
+      write ( *, '(a)' ) '  TILE_M, TILE_N and TILE_STEPS must be at least 1.'
+      stop 1
+    end if
+    write ( *, '(a,i6,a,i6,a,i4,a)' ) '  Tiles of ', tile_m, ' by ', tile_n, &
+      ' nodes, ', tile_steps, ' iterations per tile.'
+  end if
+
+  if ( solver == 'persistent' ) then
+    call option_get_i4 ( 'check', 'PLATE_CHECK', check )
+    if ( 0 < check ) then
+      write ( *, '(a,i6,a)' ) '  The change is checked every ', check, &
+        ' iterations.'
+    else
+      write ( *, '(a)' ) '  The change is checked at adaptive intervals.'
+    end if
+  end if
+
+  omega = 1.0D+00
+  if ( solver == 'sor' ) then
+    rho = 0.5D+00 &
+      * ( cos ( pi / dble ( m - 1 ) ) + cos ( pi / dble ( n - 1 ) ) )
+    omega = 2.0D+00 / ( 1.0D+00 + sqrt ( 1.0D+00 - rho * rho ) )
+    call option_get_r8 ( 'omega', 'PLATE_OMEGA', omega )
+    if ( .not. ( 0.0D+00 < omega .and. omega < 2.0D+00 ) ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'HEATED_PLATE_OPENMP - Fatal error!'
+      write ( *, '(a)' ) '  OMEGA must be strictly between 0 and 2.'
+      stop 1
+    end if
+    write ( *, '(a,g14.6)' ) '  The relaxation factor OMEGA = ', omega
+  end if
+
+  if ( solver == 'multigrid' ) then
+    call multigrid_size ( m, n, mg_levels, mg_work_size )
+    write ( *, '(a,i4)' ) '  The number of multigrid levels = ', mg_levels
+  else
+    mg_work_size = 0
+  end if
+  allocate ( mg_work(mg_work_size) )
+
+  numa_mode = 'no'
+  call option_get ( 'numa_report', 'PLATE_NUMA_REPORT', numa_mode )
+
+  profile = 'no'
+  call option_get ( 'profile', 'PLATE_PROFILE', profile )
+  call regions_init ( merge ( 1, 0, profile == 'yes' ) )
+
+  call option_get_i4 ( 'checkpoint', 'PLATE_CHECKPOINT', checkpoint )
+  checkpoint_file = 'plate.ckpt'
+  call option_get ( 'checkpoint_file', 'PLATE_CHECKPOINT_FILE', &
+    checkpoint_file )
+  restart = 'no'
+  call option_get ( 'restart', 'PLATE_RESTART', restart )
+  if ( 0 < checkpoint ) then
+    write ( *, '(a,i8,a,a)' ) '  Checkpoint every ', checkpoint, &
+      ' iterations to ', trim ( checkpoint_file )
+    checkpoint_io = async_io_create ( )
+  end if
+
+  output = ' '
+  call option_get ( 'output', 'PLATE_OUTPUT', output )
+  call option_get_i4 ( 'snapshot', 'PLATE_SNAPSHOT', snapshot )
+  if ( output /= ' ' ) then
+    write ( *, '(a,a)' ) '  The solution will be written to ', trim ( output )
+    if ( 0 < snapshot ) then
+      write ( *, '(a,i8,a)' ) '  with snapshots every ', snapshot, &
+        ' iterations.'
+    end if
+    output_io = async_io_create ( )
+  else
+    snapshot = 0
+  end if
+!
+!  First touch.  Linux places each page on the NUMA node of the thread
+!  that first writes it, so U and W are first written by the same static
+!  partition of the columns that the solvers use, and the multigrid work
+!  array by a static partition of its length.
+!
+!$omp parallel shared ( mg_work, u, w ) private ( i, j, k )
+
+  !$omp do schedule ( static )
+  do j = 1, n
+    do i = 1, m
+      u(i,j) = 0.0D+00
+      w(i,j) = 0.0D+00
+    end do
+  end do
+  !$omp end do nowait
+
+  !$omp do schedule ( static )
+  do k = 1, mg_work_size
+    mg_work(k) = 0.0D+00
+  end do
+  !$omp end do
+
+!$omp end parallel
+
   Dutch_wind_eta = 1.0D0
   write (*,*) Dutch_wind_eta 
   call get_environment_variable("GOMP_CPU_AFFINITY",cpuaffinity)
   write(*,*) trim(cpuaffinity)
+  call placement_report ( )
 !
 !  Set the boundary values, which don't change.
 !
@@ -141,14 +484,14 @@ program main
 !
 !$omp parallel shared ( w ) private ( i, j ) 
 
-  !$omp do
+  !$omp do schedule ( static )
   do i = 2, m - 1
     w(i,1) = 100.0D+00
     w(i,n) = 100.0D+00
   end do
   !$omp end do
 
-  !$omp do
+  !$omp do schedule ( static )
   do j = 1, n
     w(m,j) = 100.0D+00
     w(1,j) =   0.0D+00
@@ -158,13 +501,13 @@ program main
 !  Average the boundary values, to come up with a reasonable
 !  initial value for the interior.
 !
-  !$omp do reduction ( + : mean )
+  !$omp do schedule ( static ) reduction ( + : mean )
   do i = 2, m - 1
     mean = mean + w(i,1) + w(i,n)
   end do
   !$omp end do
 
-  !$omp do reduction ( + : mean )
+  !$omp do schedule ( static ) reduction ( + : mean )
   do j = 1, n
     mean = mean + w(1,j) + w(m,j)
   end do
@@ -185,13 +528,27 @@ program main
 !
 !$omp parallel shared ( mean, w ) private ( i, j )
 
-  !$omp do
+  !$omp do schedule ( static )
   do j = 2, n - 1
     do i = 2, m - 1
       w(i,j) = mean
     end do
   end do
   !$omp end do
+!
+!  The FUSED, TILED and PERSISTENT solvers never copy W into U, so U
+!  needs the boundary values.
+!
+  if ( solver == 'fused' .or. solver == 'tiled' .or. &
+    solver == 'persistent' ) then
+    !$omp do schedule ( static )
+    do j = 1, n
+      do i = 1, m
+        u(i,j) = w(i,j)
+      end do
+    end do
+    !$omp end do
+  end if
 
 !$omp end parallel
 !
@@ -200,65 +557,188 @@ program main
 !
   iterations = 0
   iterations_print = 1
+  swapped = .false.
+  diff = eps
+
+  if ( restart == 'yes' ) then
+    call checkpoint_read ( )
+  end if
 
   write ( *, '(a)' ) ' '
   write ( *, '(a)' ) ' Iteration  Change'
   write ( *, '(a)' ) ' '
 
   wtime = omp_get_wtime ( )
-
-  diff = eps
+!
+!  The PERSISTENT solver runs to the end in one parallel region.
+!
+  if ( solver == 'persistent' .and. eps <= diff ) then
+    call jacobi_persistent ( )
+  end if
 
   do while ( eps <= diff )
+
+    if ( solver == 'fused' ) then
+!
+!  U and W swap roles at every iteration.
+!
+      if ( swapped ) then
+        call jacobi_fused ( m, n, u, w, diff )
+      else
+        call jacobi_fused ( m, n, w, u, diff )
+      end if
+      swapped = .not. swapped
+      steps = 1
+
+    else if ( solver == 'multigrid' ) then
+
+      call multigrid_vcycle ( m, n, w, mg_work_size, mg_work, diff )
+      steps = 1
+
+    else if ( solver == 'rbgs' .or. solver == 'sor' ) then
+
+      call sor_redblack ( m, n, omega, w, diff )
+      steps = 1
+
+    else if ( solver == 'tiled' ) then
+
+      if ( swapped ) then
+        call jacobi_tiled ( m, n, tile_m, tile_n, tile_steps, u, w, diff )
+      else
+        call jacobi_tiled ( m, n, tile_m, tile_n, tile_steps, w, u, diff )
+      end if
+      swapped = .not. swapped
+      steps = tile_steps
+
+    else
 !
 !  OpenMP node: You CANNOT set DIFF to 0.0 inside the parallel region.
 !
-    diff = 0.0D+00
+      diff = 0.0D+00
 
+      call region_fork ( 'jacobi' // c_null_char )
 !$omp parallel shared ( u, w ) private ( i, j ) 
 
-    !$omp do
-    do j = 1, n
-      do i = 1, m
-        u(i,j) = w(i,j)
+      call region_start ( )
+
+      !$omp do schedule ( static )
+      do j = 1, n
+        do i = 1, m
+          u(i,j) = w(i,j)
+        end do
       end do
-    end do
-    !$omp end do
+      !$omp end do nowait
+      call region_work ( 'jacobi copy' // c_null_char )
+      !$omp barrier
+      call region_wait ( 'jacobi copy' // c_null_char )
 
-    !$omp do
-    do j = 2, n - 1
-      do i = 2, m - 1
-        w(i,j) = 0.25D+00 * ( u(i-1,j) + u(i+1,j) + u(i,j-1) + u(i,j+1) )
+      !$omp do schedule ( static )
+      do j = 2, n - 1
+        do i = 2, m - 1
+          w(i,j) = 0.25D+00 * ( u(i-1,j) + u(i+1,j) + u(i,j-1) + u(i,j+1) )
+        end do
       end do
-    end do
-    !$omp end do
+      !$omp end do nowait
+      call region_work ( 'jacobi stencil' // c_null_char )
+      !$omp barrier
+      call region_wait ( 'jacobi stencil' // c_null_char )
 
-    !$omp do reduction ( max : diff )
-    do j = 1, n
-      do i = 1, m
-        diff = max ( diff, abs ( u(i,j) - w(i,j) ) )
+      !$omp do schedule ( static ) reduction ( max : diff )
+      do j = 1, n
+        do i = 1, m
+          diff = max ( diff, abs ( u(i,j) - w(i,j) ) )
+        end do
       end do
-    end do
-    !$omp end do
+      !$omp end do nowait
+      call region_work ( 'jacobi reduction' // c_null_char )
+      !$omp barrier
+      call region_wait ( 'jacobi reduction' // c_null_char )
 
 !$omp end parallel
+      call region_join ( )
 
-    iterations = iterations + 1
+      steps = 1
 
-    if ( iterations == iterations_print ) then
-      write ( *, '(2x,i8,2x,g14.6)' ) iterations, diff
-      iterations_print = 2 * iterations_print
+    end if
+
+    call iteration_end ( steps )
+!
+!  A diverging iteration ends with an infinite or NaN change, for which
+!  the test EPS <= DIFF is false or never becomes false.
+!
+    if ( .not. ( diff <= huge ( diff ) ) ) then
+      exit
     end if
 
   end do
 
   wtime = omp_get_wtime ( ) - wtime
 
+  if ( .not. ( diff <= huge ( diff ) ) ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(2x,i8,2x,g14.6)' ) iterations, diff
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'HEATED_PLATE_OPENMP - Fatal error!'
+    write ( *, '(a)' ) '  The iteration diverged.'
+    stop 1
+  end if
+
+!
+!  If the arrays were swapped an odd number of times, the latest solution
+!  is in U.
+!
+  if ( swapped ) then
+    w(1:m,1:n) = u(1:m,1:n)
+  end if
+
   write ( *, '(a)' ) ' '
   write ( *, '(2x,i8,2x,g14.6)' ) iterations, diff
   write ( *, '(a)' ) ' '
   write ( *, '(a)' ) '  Error tolerance achieved.'
   write ( *, '(a,g14.6)' ) '  Wall clock time = ', wtime
+
+  if ( 0 < checkpoint ) then
+    ios = async_io_wait ( checkpoint_io )
+    call async_io_get_stats ( checkpoint_io, checkpoint_stats )
+    call async_io_destroy ( checkpoint_io )
+    write ( *, '(a,i8,a,f10.3,a,f10.3,a)' ) '  Checkpoints: ', &
+      int ( checkpoint_stats(1) ), ', written in ', checkpoint_stats(3), &
+      ' s in the background, solver stalled ', checkpoint_stats(4), ' s'
+  end if
+!
+!  The final solution is written like the snapshots; only the wait for the
+!  last write is not overlapped with computation.
+!
+  if ( output /= ' ' ) then
+    call output_write ( w, output )
+    output_wait = omp_get_wtime ( )
+    ios = async_io_wait ( output_io )
+    output_wait = omp_get_wtime ( ) - output_wait
+    call async_io_get_stats ( output_io, output_stats )
+    call async_io_destroy ( output_io )
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,i8,a,f12.1,a)' ) '  Output: ', int ( output_stats(1) ), &
+      ' files, ', output_stats(2) / 1.0D+06, ' MB'
+    write ( *, '(a,f10.3,a,f10.1,a)' ) '    written in ', output_stats(3), &
+      ' s by the writer thread, ', &
+      output_stats(2) / max ( output_stats(3), 1.0D-09 ) / 1.0D+06, ' MB/s'
+    write ( *, '(a,f10.3,a,f10.3,a,f10.3,a)' ) '    solver stalled ', &
+      output_stats(4), ' s of ', wtime, ' s compute, final wait ', &
+      output_wait, ' s'
+    if ( 0 < output_stats(5) ) then
+      write ( *, '(a,i8,a)' ) '    ', int ( output_stats(5) ), &
+        ' files could not be written.'
+    end if
+  end if
+
+  if ( numa_mode == 'yes' ) then
+    call numa_report ( )
+  end if
+
+  if ( profile == 'yes' ) then
+    flush ( 6 )
+    call regions_report ( )
+  end if
 !
 !  Terminate.
 !
@@ -266,5 +746,1568 @@ program main
   write ( *, '(a)' ) 'HEATED_PLATE_OPENMP:'
   write ( *, '(a)' ) '  Normal end of execution.'
 
+  deallocate ( mg_work )
+  deallocate ( u )
+  deallocate ( w )
+
   stop
+contains
+  subroutine checkpoint_read ( )
+
+!*****************************************************************************80
+!
+!! CHECKPOINT_READ resumes the iteration from CHECKPOINT_FILE.
+!
+!  Discussion:
+!
+!    The solution goes into W, whose boundary values it shares, and U and
+!    W start again unswapped.  The solvers never read the old interior of
+!    the array they write, so this does not change any iterate.
+!
+    integer ( kind = 8 ) header(8)
+    integer ( kind = 4 ) ios
+    integer ( kind = 4 ) unit
+
+    open ( newunit = unit, file = checkpoint_file, status = 'old', &
+      access = 'stream', form = 'unformatted', action = 'read', &
+      iostat = ios )
+    if ( ios == 0 ) then
+      read ( unit, iostat = ios ) header, diff
+    end if
+    if ( ios == 0 ) then
+      if ( header(1) /= transfer ( 'PLATECKP', 0_8 ) .or. &
+        header(2) /= m .or. header(3) /= n .or. &
+        any ( header(6:7) /= transfer ( solver(1:16), 0_8, 2 ) ) ) then
+        ios = -1
+      end if
+    end if
+    if ( ios == 0 ) then
+      read ( unit, iostat = ios ) w
+    end if
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'HEATED_PLATE_OPENMP - Fatal error!'
+      write ( *, '(a,a)' ) '  Cannot restart from ', trim ( checkpoint_file )
+      write ( *, '(a)' ) &
+        '  It is missing, damaged, or for another M, N or SOLVER.'
+      stop 1
+    end if
+    close ( unit )
+
+    iterations = int ( header(4) )
+    iterations_print = int ( header(5) )
+    swapped = .false.
+
+    if ( solver == 'fused' .or. solver == 'tiled' .or. &
+      solver == 'persistent' ) then
+      u(1:m,1:n) = w(1:m,1:n)
+    end if
+
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,a,a,i8)' ) '  Restarted from ', trim ( checkpoint_file ), &
+      ' at iteration ', iterations
+
+    return
+  end subroutine checkpoint_read
+  subroutine checkpoint_write ( a )
+
+!*****************************************************************************80
+!
+!! CHECKPOINT_WRITE queues the state, with the latest solution A, for writing.
+!
+    real ( kind = 8 ) a(m,n)
+    integer ( kind = 8 ) header(8)
+
+    header(1) = transfer ( 'PLATECKP', 0_8 )
+    header(2) = m
+    header(3) = n
+    header(4) = iterations
+    header(5) = iterations_print
+    header(6:7) = transfer ( solver(1:16), 0_8, 2 )
+    header(8) = 0
+
+    call async_io_begin ( checkpoint_io, &
+      trim ( checkpoint_file ) // c_null_char )
+    call async_io_append ( checkpoint_io, header, 8_c_size_t * 8 )
+    call async_io_append ( checkpoint_io, [ diff ], 8_c_size_t )
+    call async_io_append ( checkpoint_io, a, 8_c_size_t * m * n )
+    call async_io_commit ( checkpoint_io )
+
+    return
+  end subroutine checkpoint_write
+  subroutine iteration_end ( steps )
+
+!*****************************************************************************80
+!
+!! ITERATION_END counts STEPS more iterations, and reports and saves them.
+!
+!  Discussion:
+!
+!    The progress line is printed when the count reaches ITERATIONS_PRINT,
+!    and the state is saved when it passes a multiple of CHECKPOINT or of
+!    SNAPSHOT.  SWAPPED tells which of U and W holds the latest solution.
+!
+    integer ( kind = 4 ) steps
+
+    iterations = iterations + steps
+
+    if ( iterations_print <= iterations ) then
+      write ( *, '(2x,i8,2x,g14.6)' ) iterations, diff
+      do while ( iterations_print <= iterations )
+        iterations_print = 2 * iterations_print
+      end do
+    end if
+!
+!  Save the state when the iteration count passes a multiple of CHECKPOINT.
+!
+    if ( 0 < checkpoint ) then
+      if ( ( iterations - steps ) / checkpoint < iterations / checkpoint ) then
+        if ( swapped ) then
+          call checkpoint_write ( u )
+        else
+          call checkpoint_write ( w )
+        end if
+      end if
+    end if
+
+    if ( 0 < snapshot ) then
+      if ( ( iterations - steps ) / snapshot < iterations / snapshot ) then
+        write ( path, '(a,a,i8.8)' ) trim ( output ), '.', iterations
+        if ( swapped ) then
+          call output_write ( u, path )
+        else
+          call output_write ( w, path )
+        end if
+      end if
+    end if
+
+    return
+  end subroutine iteration_end
+  subroutine jacobi_persistent ( )
+
+!*****************************************************************************80
+!
+!! JACOBI_PERSISTENT carries out Jacobi iterations in one parallel region.
+!
+!  Discussion:
+!
+!    U and W swap roles at every iteration, as for the FUSED solver.  The
+!    columns are shared among the threads by the same static schedule at
+!    every iteration, and the barrier after each iteration is the only
+!    synchronization, as the next one reads the neighboring columns.
+!
+!    The change is only computed at the last iteration before a check.
+!    Each thread stores the change of its own columns in DIFF_THREAD, and
+!    after the barrier every thread takes the maximum, so that they all
+!    agree on whether to stop without another barrier.  Alternate checks
+!    use alternate columns of DIFF_THREAD, so that a thread cannot
+!    overwrite a value that a slower thread has yet to read.
+!
+!    At a check, the master thread reports the progress and queues the
+!    checkpoints and snapshots while the others go on: the next iteration
+!    only writes the older array, and the barrier after it waits for the
+!    master.
+!
+!    With CHECK = 0, the interval to the next check is half the number of
+!    iterations left, as predicted from the rate at which the change fell
+!    since the previous check, and at most 64.
+!
+    integer ( kind = 4 ), parameter :: check_max = 64
+    real ( kind = 8 ) d
+    real ( kind = 8 ) d_old
+    real ( kind = 8 ), allocatable :: diff_thread(:,:)
+    integer ( kind = 4 ) done
+    integer ( kind = 4 ) id
+    logical in_u
+    integer ( kind = 4 ) interval
+    integer ( kind = 4 ) parity
+    real ( kind = 8 ) remaining
+
+    allocate ( diff_thread(0:omp_get_max_threads()-1,0:1) )
+
+    call region_fork ( 'persistent' // c_null_char )
+!$omp parallel shared ( diff_thread ) &
+!$omp private ( d, d_old, done, id, in_u, interval, parity, remaining )
+
+    call region_start ( )
+
+    id = omp_get_thread_num ( )
+    in_u = swapped
+    parity = 0
+    d_old = 0.0D+00
+    done = 0
+    if ( 0 < check ) then
+      interval = check
+    else
+      interval = 1
+    end if
+
+    do
+
+      done = done + 1
+      if ( in_u ) then
+        call jacobi_sweep ( m, n, u, w, done == interval, &
+          diff_thread(id,parity) )
+      else
+        call jacobi_sweep ( m, n, w, u, done == interval, &
+          diff_thread(id,parity) )
+      end if
+      in_u = .not. in_u
+      call region_work ( 'persistent sweep' // c_null_char )
+!$omp barrier
+      call region_wait ( 'persistent sweep' // c_null_char )
+
+      if ( done == interval ) then
+
+        d = maxval ( diff_thread(0:omp_get_num_threads()-1,parity) )
+        parity = 1 - parity
+
+!$omp master
+        diff = d
+        swapped = in_u
+        call iteration_end ( done )
+!$omp end master
+
+        if ( d < eps ) then
+          exit
+        end if
+
+        if ( check == 0 .and. 0.0D+00 < d .and. d < d_old ) then
+          remaining = done * log ( eps / d ) / log ( d / d_old )
+          interval = max ( 1, int ( min ( dble ( check_max ), &
+            0.5D+00 * remaining ) ) )
+        end if
+        d_old = d
+        done = 0
+
+      end if
+
+    end do
+
+!$omp end parallel
+    call region_join ( )
+
+    deallocate ( diff_thread )
+
+    return
+  end subroutine jacobi_persistent
+  subroutine output_write ( a, file )
+
+!*****************************************************************************80
+!
+!! OUTPUT_WRITE queues the solution A, with its header, for writing to FILE.
+!
+    real ( kind = 8 ) a(m,n)
+    character ( len = * ) file
+    character ( len = 4096 ) header
+    character ( len = 1 ), parameter :: nl = achar ( 10 )
+    character ( len = 6 ) order
+
+    if ( ichar ( transfer ( 1_4, 'a' ) ) == 1 ) then
+      order = 'little'
+    else
+      order = 'big'
+    end if
+
+    header = ' '
+    write ( header, '(a,a,a,i0,a,a,i0,a,a,i0,a,a,g14.6,a,a,a,a,a,a,a,a)' ) &
+      'HEATED_PLATE_OUTPUT 1', nl, &
+      'm ', m, nl, &
+      'n ', n, nl, &
+      'iterations ', iterations, nl, &
+      'diff ', diff, nl, &
+      'type float64', nl, &
+      'byte_order ', trim ( order ), nl, &
+      'order fortran', nl
+    header = trim ( header ) // 'offset 4096' // nl
+    header(4096:4096) = nl
+
+    call async_io_begin ( output_io, trim ( file ) // c_null_char )
+    call async_io_append ( output_io, header, 4096_c_size_t )
+    call async_io_append ( output_io, a, 8_c_size_t * m * n )
+    call async_io_commit ( output_io )
+
+    return
+  end subroutine output_write
+end
+subroutine jacobi_fused ( m, n, u, w, diff )
+
+!*****************************************************************************80
+!
+!! JACOBI_FUSED carries out one Jacobi iteration in a single pass.
+!
+!  Discussion:
+!
+!    The interior of W is computed from U, and the largest change is
+!    found at the same time.  The boundary of W is not touched, so it must
+!    already hold the boundary values.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the grid.
+!
+!    Input, real ( kind = 8 ) U(M,N), the solution at the previous iteration.
+!
+!    Input/output, real ( kind = 8 ) W(M,N), the solution at the new
+!    iteration.
+!
+!    Output, real ( kind = 8 ) DIFF, the largest change in the solution.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  real ( kind = 8 ) u(m,n)
+  real ( kind = 8 ) w(m,n)
+
+  diff = 0.0D+00
+
+  call region_fork ( 'jacobi_fused' // c_null_char )
+!$omp parallel shared ( u, w ) private ( i, j )
+
+  call region_start ( )
+
+  !$omp do schedule ( static ) reduction ( max : diff )
+  do j = 2, n - 1
+    do i = 2, m - 1
+      w(i,j) = 0.25D+00 * ( u(i-1,j) + u(i+1,j) + u(i,j-1) + u(i,j+1) )
+      diff = max ( diff, abs ( u(i,j) - w(i,j) ) )
+    end do
+  end do
+  !$omp end do nowait
+  call region_work ( 'jacobi_fused' // c_null_char )
+  !$omp barrier
+  call region_wait ( 'jacobi_fused' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  return
+end
+subroutine jacobi_sweep ( m, n, u, w, check, diff )
+
+!*****************************************************************************80
+!
+!! JACOBI_SWEEP carries out the calling thread's share of a Jacobi iteration.
+!
+!  Discussion:
+!
+!    It is called by every thread of a parallel region.  The columns are
+!    shared by a static schedule, and there is no barrier at the end.
+!    The interior of W is computed from U; if CHECK, DIFF is set to the
+!    largest change in the thread's columns.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the grid.
+!
+!    Input, real ( kind = 8 ) U(M,N), the solution at the previous iteration.
+!
+!    Input/output, real ( kind = 8 ) W(M,N), the solution at the new
+!    iteration.
+!
+!    Input, logical CHECK, is true if the change is wanted.
+!
+!    Output, real ( kind = 8 ) DIFF, the largest change in the thread's
+!    columns, if CHECK.
+!
+  implicit none
+
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+
+  real ( kind = 8 ) change
+  logical check
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  real ( kind = 8 ) u(m,n)
+  real ( kind = 8 ) w(m,n)
+
+  if ( check ) then
+!
+!  DIFF is another thread's neighbor in memory, so the change is kept in
+!  a local variable until the end.
+!
+    change = 0.0D+00
+
+    !$omp do schedule ( static )
+    do j = 2, n - 1
+      do i = 2, m - 1
+        w(i,j) = 0.25D+00 * ( u(i-1,j) + u(i+1,j) + u(i,j-1) + u(i,j+1) )
+        change = max ( change, abs ( u(i,j) - w(i,j) ) )
+      end do
+    end do
+    !$omp end do nowait
+
+    diff = change
+
+  else
+
+    !$omp do schedule ( static )
+    do j = 2, n - 1
+      do i = 2, m - 1
+        w(i,j) = 0.25D+00 * ( u(i-1,j) + u(i+1,j) + u(i,j-1) + u(i,j+1) )
+      end do
+    end do
+    !$omp end do nowait
+
+  end if
+
+  return
+end
+subroutine jacobi_tile ( m, n, ie0, ie1, je0, je1, i0, i1, j0, j1, steps, &
+  u, w, a, b, diff )
+
+!*****************************************************************************80
+!
+!! JACOBI_TILE carries out several Jacobi iterations on one tile.
+!
+!  Discussion:
+!
+!    The tile is the block I0:I1, J0:J1 of the grid.  It is extended by
+!    STEPS nodes on each side, to IE0:IE1, JE0:JE1, limited by the edges of
+!    the grid, and the extended block of U is copied into A and B.
+!
+!    Each iteration then updates a block that is one node smaller on each
+!    side than the one before, except on the sides that lie on the grid
+!    boundary, whose values are fixed.  After STEPS iterations, the nodes
+!    of the tile have the same values as STEPS iterations on the whole grid
+!    would give them, and they are copied into W.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the grid.
+!
+!    Input, integer ( kind = 4 ) IE0, IE1, JE0, JE1, the extended tile.
+!
+!    Input, integer ( kind = 4 ) I0, I1, J0, J1, the tile.
+!
+!    Input, integer ( kind = 4 ) STEPS, the number of iterations.
+!
+!    Input, real ( kind = 8 ) U(M,N), the solution before the iterations.
+!
+!    Input/output, real ( kind = 8 ) W(M,N), the solution after the
+!    iterations.  Only the tile is set.
+!
+!    Workspace, real ( kind = 8 ) A(IE0:IE1,JE0:JE1), B(IE0:IE1,JE0:JE1).
+!
+!    Input/output, real ( kind = 8 ) DIFF, the largest change in the last
+!    iteration so far.
+!
+  implicit none
+
+  integer ( kind = 4 ) ie0
+  integer ( kind = 4 ) ie1
+  integer ( kind = 4 ) je0
+  integer ( kind = 4 ) je1
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+
+  real ( kind = 8 ) a(ie0:ie1,je0:je1)
+  real ( kind = 8 ) b(ie0:ie1,je0:je1)
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) i0
+  integer ( kind = 4 ) i1
+  integer ( kind = 4 ) i_hi
+  integer ( kind = 4 ) i_lo
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) j0
+  integer ( kind = 4 ) j1
+  integer ( kind = 4 ) j_hi
+  integer ( kind = 4 ) j_lo
+  integer ( kind = 4 ) s
+  integer ( kind = 4 ) steps
+  real ( kind = 8 ) u(m,n)
+  real ( kind = 8 ) w(m,n)
+
+  do j = je0, je1
+    do i = ie0, ie1
+      a(i,j) = u(i,j)
+      b(i,j) = u(i,j)
+    end do
+  end do
+
+  do s = 1, steps
+
+    if ( ie0 == 1 ) then
+      i_lo = 2
+    else
+      i_lo = ie0 + s
+    end if
+    if ( ie1 == m ) then
+      i_hi = m - 1
+    else
+      i_hi = ie1 - s
+    end if
+    if ( je0 == 1 ) then
+      j_lo = 2
+    else
+      j_lo = je0 + s
+    end if
+    if ( je1 == n ) then
+      j_hi = n - 1
+    else
+      j_hi = je1 - s
+    end if
+
+    if ( mod ( s, 2 ) == 1 ) then
+      do j = j_lo, j_hi
+        do i = i_lo, i_hi
+          b(i,j) = 0.25D+00 * ( a(i-1,j) + a(i+1,j) + a(i,j-1) + a(i,j+1) )
+        end do
+      end do
+    else
+      do j = j_lo, j_hi
+        do i = i_lo, i_hi
+          a(i,j) = 0.25D+00 * ( b(i-1,j) + b(i+1,j) + b(i,j-1) + b(i,j+1) )
+        end do
+      end do
+    end if
+
+  end do
+!
+!  Copy the tile out, and compare the last two iterates on it.
+!
+  if ( mod ( steps, 2 ) == 1 ) then
+    do j = j0, j1
+      do i = i0, i1
+        w(i,j) = b(i,j)
+        diff = max ( diff, abs ( b(i,j) - a(i,j) ) )
+      end do
+    end do
+  else
+    do j = j0, j1
+      do i = i0, i1
+        w(i,j) = a(i,j)
+        diff = max ( diff, abs ( a(i,j) - b(i,j) ) )
+      end do
+    end do
+  end if
+
+  return
+end
+subroutine jacobi_tiled ( m, n, tile_m, tile_n, steps, u, w, diff )
+
+!*****************************************************************************80
+!
+!! JACOBI_TILED carries out several Jacobi iterations, tile by tile.
+!
+!  Discussion:
+!
+!    The tiles are independent, and are shared out among the threads.
+!    Each thread allocates its own tile buffers once.
+!
+!    The halo of each tile is computed again by the tiles next to it, so
+!    the work per iteration grows with STEPS relative to the tile size,
+!    while the traffic to memory shrinks like 1/STEPS.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the grid.
+!
+!    Input, integer ( kind = 4 ) TILE_M, TILE_N, the size of the tiles.
+!
+!    Input, integer ( kind = 4 ) STEPS, the number of iterations.
+!
+!    Input, real ( kind = 8 ) U(M,N), the solution before the iterations.
+!
+!    Input/output, real ( kind = 8 ) W(M,N), the solution after the
+!    iterations.  The boundary of W must hold the boundary values.
+!
+!    Output, real ( kind = 8 ) DIFF, the largest change in the solution
+!    in the last iteration.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+
+  real ( kind = 8 ), allocatable :: a(:)
+  real ( kind = 8 ), allocatable :: b(:)
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) i0
+  integer ( kind = 4 ) i1
+  integer ( kind = 4 ) ie0
+  integer ( kind = 4 ) ie1
+  integer ( kind = 4 ) j0
+  integer ( kind = 4 ) j1
+  integer ( kind = 4 ) je0
+  integer ( kind = 4 ) je1
+  integer ( kind = 4 ) steps
+  integer ( kind = 4 ) tile_m
+  integer ( kind = 4 ) tile_n
+  real ( kind = 8 ) u(m,n)
+  real ( kind = 8 ) w(m,n)
+
+  diff = 0.0D+00
+
+  call region_fork ( 'jacobi_tiled' // c_null_char )
+!$omp parallel shared ( u, w ) &
+!$omp private ( a, b, i0, i1, ie0, ie1, j0, j1, je0, je1 )
+
+  call region_start ( )
+
+  allocate ( a((tile_m+2*steps)*(tile_n+2*steps)) )
+  allocate ( b((tile_m+2*steps)*(tile_n+2*steps)) )
+
+  !$omp do collapse ( 2 ) schedule ( static ) reduction ( max : diff )
+  do j0 = 1, n, tile_n
+    do i0 = 1, m, tile_m
+      i1 = min ( m, i0 + tile_m - 1 )
+      j1 = min ( n, j0 + tile_n - 1 )
+      ie0 = max ( 1, i0 - steps )
+      ie1 = min ( m, i1 + steps )
+      je0 = max ( 1, j0 - steps )
+      je1 = min ( n, j1 + steps )
+      call jacobi_tile ( m, n, ie0, ie1, je0, je1, i0, i1, j0, j1, steps, &
+        u, w, a, b, diff )
+    end do
+  end do
+  !$omp end do nowait
+  call region_work ( 'jacobi_tiled' // c_null_char )
+  !$omp barrier
+  call region_wait ( 'jacobi_tiled' // c_null_char )
+
+  deallocate ( a )
+  deallocate ( b )
+
+!$omp end parallel
+  call region_join ( )
+
+  return
+end
+subroutine multigrid_layout ( m, n, level_max, levels, mg, ng, ou, of, &
+  ox, oy, work_size )
+
+!*****************************************************************************80
+!
+!! MULTIGRID_LAYOUT lays out the multigrid levels in a workspace.
+!
+!  Discussion:
+!
+!    Coarse node I of a grid of M nodes lies on fine node min(2*I-1,M), so
+!    that the coarse grid has (M+2)/2 nodes and the same end points.  If M
+!    is even, the last coarse interval is only one fine interval long, so
+!    the coarse grids are not uniform, and each level keeps the coordinates
+!    of its nodes.  Grids are coarsened until one has 5 nodes or fewer in
+!    some direction.
+!
+!    Level L uses, starting at the given offsets in the workspace:
+!
+!      OU(L): the solution, MG(L) by NG(L);
+!      OF(L): the right hand side, MG(L) by NG(L);
+!      OX(L): the node coordinates and stencil coefficients in the I
+!             direction, MG(L) by 3;
+!      OY(L): the same in the J direction, NG(L) by 3.
+!
+!    The residual of the finest grid, M by N, is kept at the end.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the finest grid.
+!
+!    Input, integer ( kind = 4 ) LEVEL_MAX, the maximum number of levels.
+!
+!    Output, integer ( kind = 4 ) LEVELS, the number of levels.
+!
+!    Output, integer ( kind = 4 ) MG(LEVEL_MAX), NG(LEVEL_MAX), the size of
+!    each grid.
+!
+!    Output, integer ( kind = 4 ) OU(LEVEL_MAX), OF(LEVEL_MAX),
+!    OX(LEVEL_MAX), OY(LEVEL_MAX), the offsets of each level's data.
+!
+!    Output, integer ( kind = 4 ) WORK_SIZE, the size of the workspace.
+!
+  implicit none
+
+  integer ( kind = 4 ) level_max
+
+  integer ( kind = 4 ) l
+  integer ( kind = 4 ) levels
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) mg(level_max)
+  integer ( kind = 4 ) n
+  integer ( kind = 4 ) ng(level_max)
+  integer ( kind = 4 ) of(level_max)
+  integer ( kind = 4 ) ou(level_max)
+  integer ( kind = 4 ) ox(level_max)
+  integer ( kind = 4 ) oy(level_max)
+  integer ( kind = 4 ) work_size
+
+  levels = 1
+  mg(1) = m
+  ng(1) = n
+
+  do while ( 5 < min ( mg(levels), ng(levels) ) .and. levels < level_max )
+    levels = levels + 1
+    mg(levels) = ( mg(levels-1) + 2 ) / 2
+    ng(levels) = ( ng(levels-1) + 2 ) / 2
+  end do
+
+  work_size = 1
+  do l = 1, levels
+    ou(l) = work_size
+    of(l) = ou(l) + mg(l) * ng(l)
+    ox(l) = of(l) + mg(l) * ng(l)
+    oy(l) = ox(l) + 3 * mg(l)
+    work_size = oy(l) + 3 * ng(l)
+  end do
+
+  work_size = work_size + m * n - 1
+
+  return
+end
+subroutine multigrid_line ( m, ax )
+
+!*****************************************************************************80
+!
+!! MULTIGRID_LINE sets the stencil coefficients along one grid direction.
+!
+!  Discussion:
+!
+!    On entry, AX(1:M,1) holds the node coordinates.  The second difference
+!    at node I, over intervals of length HW to the left and HE to the
+!    right, is
+!
+!      AX(I,2) * ( U(I-1) - U(I) ) + AX(I,3) * ( U(I+1) - U(I) )
+!
+!    with AX(I,2) = 2 / ( HW * ( HW + HE ) ) and
+!    AX(I,3) = 2 / ( HE * ( HW + HE ) ).
+!    On a uniform grid of spacing 1, both are 1.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, the number of nodes.
+!
+!    Input/output, real ( kind = 8 ) AX(M,3), the coordinates, and on
+!    output the coefficients.
+!
+  implicit none
+
+  integer ( kind = 4 ) m
+
+  real ( kind = 8 ) ax(m,3)
+  real ( kind = 8 ) he
+  real ( kind = 8 ) hw
+  integer ( kind = 4 ) i
+
+  ax(1,2:3) = 0.0D+00
+  ax(m,2:3) = 0.0D+00
+
+  do i = 2, m - 1
+    hw = ax(i,1) - ax(i-1,1)
+    he = ax(i+1,1) - ax(i,1)
+    ax(i,2) = 2.0D+00 / ( hw * ( hw + he ) )
+    ax(i,3) = 2.0D+00 / ( he * ( hw + he ) )
+  end do
+
+  return
+end
+subroutine multigrid_prolong ( mc, nc, axc, ayc, uc, m, n, ax, ay, u )
+
+!*****************************************************************************80
+!
+!! MULTIGRID_PROLONG adds the bilinear interpolant of a coarse correction.
+!
+!  Discussion:
+!
+!    Fine node I lies between coarse nodes (I+1)/2 and I/2+1, which are the
+!    same node if I is odd.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) MC, NC, the size of the coarse grid.
+!
+!    Input, real ( kind = 8 ) AXC(MC,3), AYC(NC,3), the coarse coordinates.
+!
+!    Input, real ( kind = 8 ) UC(MC,NC), the coarse correction.
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the fine grid.
+!
+!    Input, real ( kind = 8 ) AX(M,3), AY(N,3), the fine coordinates.
+!
+!    Input/output, real ( kind = 8 ) U(M,N), the fine solution.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) mc
+  integer ( kind = 4 ) n
+  integer ( kind = 4 ) nc
+
+  real ( kind = 8 ) ax(m,3)
+  real ( kind = 8 ) axc(mc,3)
+  real ( kind = 8 ) ay(n,3)
+  real ( kind = 8 ) ayc(nc,3)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) i1
+  integer ( kind = 4 ) i2
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) j1
+  integer ( kind = 4 ) j2
+  real ( kind = 8 ) s
+  real ( kind = 8 ) t
+  real ( kind = 8 ) u(m,n)
+  real ( kind = 8 ) uc(mc,nc)
+
+  call region_fork ( 'multigrid_prolong' // c_null_char )
+!$omp parallel shared ( ax, axc, ay, ayc, u, uc ) &
+!$omp private ( i, i1, i2, j, j1, j2, s, t )
+
+  call region_start ( )
+
+  !$omp do schedule ( static )
+  do j = 2, n - 1
+    j1 = ( j + 1 ) / 2
+    j2 = j / 2 + 1
+    if ( j1 == j2 ) then
+      t = 0.0D+00
+    else
+      t = ( ay(j,1) - ayc(j1,1) ) / ( ayc(j2,1) - ayc(j1,1) )
+    end if
+    do i = 2, m - 1
+      i1 = ( i + 1 ) / 2
+      i2 = i / 2 + 1
+      if ( i1 == i2 ) then
+        s = 0.0D+00
+      else
+        s = ( ax(i,1) - axc(i1,1) ) / ( axc(i2,1) - axc(i1,1) )
+      end if
+      u(i,j) = u(i,j) &
+        + ( 1.0D+00 - s ) * ( 1.0D+00 - t ) * uc(i1,j1) &
+        + s * ( 1.0D+00 - t ) * uc(i2,j1) &
+        + ( 1.0D+00 - s ) * t * uc(i1,j2) &
+        + s * t * uc(i2,j2)
+    end do
+  end do
+  !$omp end do nowait
+  call region_work ( 'multigrid_prolong' // c_null_char )
+  !$omp barrier
+  call region_wait ( 'multigrid_prolong' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  return
+end
+subroutine multigrid_restrict ( m, n, ax, ay, u, f, r, mc, nc, fc, uc )
+
+!*****************************************************************************80
+!
+!! MULTIGRID_RESTRICT sets up the coarse grid equation for the correction.
+!
+!  Discussion:
+!
+!    The residual R = F - A*U is computed on the fine grid, and its full
+!    weighting average around each coarse node becomes the right hand side
+!    FC of the coarse equation.  The coarse correction UC starts at zero.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the fine grid.
+!
+!    Input, real ( kind = 8 ) AX(M,3), AY(N,3), the fine coordinates and
+!    stencil coefficients.
+!
+!    Input, real ( kind = 8 ) U(M,N), F(M,N), the fine solution and right
+!    hand side.
+!
+!    Workspace, real ( kind = 8 ) R(M,N).
+!
+!    Input, integer ( kind = 4 ) MC, NC, the size of the coarse grid.
+!
+!    Output, real ( kind = 8 ) FC(MC,NC), UC(MC,NC), the coarse right hand
+!    side and correction.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) mc
+  integer ( kind = 4 ) n
+  integer ( kind = 4 ) nc
+
+  real ( kind = 8 ) ax(m,3)
+  real ( kind = 8 ) ay(n,3)
+  real ( kind = 8 ) f(m,n)
+  real ( kind = 8 ) fc(mc,nc)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) ic
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) jc
+  real ( kind = 8 ) r(m,n)
+  real ( kind = 8 ) u(m,n)
+  real ( kind = 8 ) uc(mc,nc)
+
+  call region_fork ( 'multigrid_restrict' // c_null_char )
+!$omp parallel shared ( ax, ay, f, fc, r, u, uc ) private ( i, ic, j, jc )
+
+  call region_start ( )
+
+!
+!  The residual is zero on the boundary, where U is fixed.
+!
+  !$omp do schedule ( static )
+  do j = 1, n
+    r(1,j) = 0.0D+00
+    r(m,j) = 0.0D+00
+  end do
+  !$omp end do nowait
+
+  !$omp do schedule ( static )
+  do i = 2, m - 1
+    r(i,1) = 0.0D+00
+    r(i,n) = 0.0D+00
+  end do
+  !$omp end do nowait
+
+  !$omp do schedule ( static )
+  do j = 2, n - 1
+    do i = 2, m - 1
+      r(i,j) = f(i,j) &
+        + ax(i,2) * ( u(i-1,j) - u(i,j) ) + ax(i,3) * ( u(i+1,j) - u(i,j) ) &
+        + ay(j,2) * ( u(i,j-1) - u(i,j) ) + ay(j,3) * ( u(i,j+1) - u(i,j) )
+    end do
+  end do
+  !$omp end do nowait
+  call region_work ( 'multigrid_restrict residual' // c_null_char )
+  !$omp barrier
+  call region_wait ( 'multigrid_restrict residual' // c_null_char )
+
+  !$omp do schedule ( static )
+  do jc = 1, nc
+    do ic = 1, mc
+      uc(ic,jc) = 0.0D+00
+      if ( ic == 1 .or. ic == mc .or. jc == 1 .or. jc == nc ) then
+        fc(ic,jc) = 0.0D+00
+      else
+        i = 2 * ic - 1
+        j = 2 * jc - 1
+        fc(ic,jc) = ( 4.0D+00 * r(i,j) &
+          + 2.0D+00 * ( r(i-1,j) + r(i+1,j) + r(i,j-1) + r(i,j+1) ) &
+          + r(i-1,j-1) + r(i+1,j-1) + r(i-1,j+1) + r(i+1,j+1) ) / 16.0D+00
+      end if
+    end do
+  end do
+  !$omp end do nowait
+  call region_work ( 'multigrid_restrict coarse' // c_null_char )
+  !$omp barrier
+  call region_wait ( 'multigrid_restrict coarse' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  return
+end
+subroutine multigrid_size ( m, n, levels, work_size )
+
+!*****************************************************************************80
+!
+!! MULTIGRID_SIZE returns the number of levels and the workspace size.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the finest grid.
+!
+!    Output, integer ( kind = 4 ) LEVELS, the number of levels.
+!
+!    Output, integer ( kind = 4 ) WORK_SIZE, the size of the workspace.
+!
+  implicit none
+
+  integer ( kind = 4 ), parameter :: level_max = 32
+
+  integer ( kind = 4 ) levels
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) mg(level_max)
+  integer ( kind = 4 ) n
+  integer ( kind = 4 ) ng(level_max)
+  integer ( kind = 4 ) of(level_max)
+  integer ( kind = 4 ) ou(level_max)
+  integer ( kind = 4 ) ox(level_max)
+  integer ( kind = 4 ) oy(level_max)
+  integer ( kind = 4 ) work_size
+
+  call multigrid_layout ( m, n, level_max, levels, mg, ng, ou, of, ox, oy, &
+    work_size )
+
+  return
+end
+subroutine multigrid_smooth ( m, n, ax, ay, u, f, sweeps )
+
+!*****************************************************************************80
+!
+!! MULTIGRID_SMOOTH applies red-black Gauss-Seidel sweeps to A*U = F.
+!
+!  Discussion:
+!
+!    Each node is set so that its equation
+!
+!      AX(I,2) * ( U(I-1,J) - U(I,J) ) + AX(I,3) * ( U(I+1,J) - U(I,J) )
+!    + AY(J,2) * ( U(I,J-1) - U(I,J) ) + AY(J,3) * ( U(I,J+1) - U(I,J) )
+!    + F(I,J) = 0
+!
+!    holds.  On the finest grid, this is the Jacobi update formula.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the grid.
+!
+!    Input, real ( kind = 8 ) AX(M,3), AY(N,3), the coordinates and
+!    stencil coefficients.
+!
+!    Input/output, real ( kind = 8 ) U(M,N), the solution.
+!
+!    Input, real ( kind = 8 ) F(M,N), the right hand side.
+!
+!    Input, integer ( kind = 4 ) SWEEPS, the number of sweeps.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+
+  real ( kind = 8 ) ax(m,3)
+  real ( kind = 8 ) ay(n,3)
+  integer ( kind = 4 ) color
+  real ( kind = 8 ) f(m,n)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) sweep
+  integer ( kind = 4 ) sweeps
+  real ( kind = 8 ) u(m,n)
+
+  call region_fork ( 'multigrid_smooth' // c_null_char )
+!$omp parallel shared ( ax, ay, f, u ) private ( color, i, j, sweep )
+
+  call region_start ( )
+
+  do sweep = 1, sweeps
+    do color = 0, 1
+
+      !$omp do schedule ( static )
+      do j = 2, n - 1
+        do i = 2 + mod ( j + color, 2 ), m - 1, 2
+          u(i,j) = ( ax(i,2) * u(i-1,j) + ax(i,3) * u(i+1,j) &
+            + ay(j,2) * u(i,j-1) + ay(j,3) * u(i,j+1) + f(i,j) ) &
+            / ( ax(i,2) + ax(i,3) + ay(j,2) + ay(j,3) )
+        end do
+      end do
+      !$omp end do nowait
+      call region_work ( 'multigrid_smooth' // c_null_char )
+      !$omp barrier
+      call region_wait ( 'multigrid_smooth' // c_null_char )
+
+    end do
+  end do
+
+!$omp end parallel
+  call region_join ( )
+
+  return
+end
+subroutine multigrid_vcycle ( m, n, w, work_size, work, diff )
+
+!*****************************************************************************80
+!
+!! MULTIGRID_VCYCLE carries out one multigrid V-cycle.
+!
+!  Discussion:
+!
+!    The steady state satisfies A*W = 0, where A is the five point
+!    Laplacian on the grid of unit spacing, and the boundary values of W
+!    are given.
+!
+!    On the way down, each grid is smoothed, and the equation for the
+!    correction on the next coarser grid, with zero boundary values, is
+!    set up from the residual.  The coarsest grid is smoothed until it is
+!    solved.  On the way up, the correction from the coarser grid is
+!    interpolated and added in, and the grid is smoothed again.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the grid.
+!
+!    Input/output, real ( kind = 8 ) W(M,N), the solution.
+!
+!    Input, integer ( kind = 4 ) WORK_SIZE, the workspace size returned
+!    by MULTIGRID_SIZE.
+!
+!    Workspace, real ( kind = 8 ) WORK(WORK_SIZE).
+!
+!    Output, real ( kind = 8 ) DIFF, the largest change in the solution.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ), parameter :: level_max = 32
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+  integer ( kind = 4 ) work_size
+
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) l
+  integer ( kind = 4 ) levels
+  integer ( kind = 4 ) mg(level_max)
+  integer ( kind = 4 ) ng(level_max)
+  integer ( kind = 4 ) of(level_max)
+  integer ( kind = 4 ) ou(level_max)
+  integer ( kind = 4 ) ox(level_max)
+  integer ( kind = 4 ) oy(level_max)
+  integer ( kind = 4 ) size
+  integer ( kind = 4 ), parameter :: sweeps_post = 2
+  integer ( kind = 4 ), parameter :: sweeps_pre = 2
+  real ( kind = 8 ) w(m,n)
+  real ( kind = 8 ) work(work_size)
+
+  call multigrid_layout ( m, n, level_max, levels, mg, ng, ou, of, ox, oy, &
+    size )
+!
+!  The finest grid has unit spacing, and each coarser grid takes every
+!  other node of the one before, and the last one.
+!
+  do i = 1, m
+    work(ox(1)+i-1) = dble ( i - 1 )
+  end do
+  do j = 1, n
+    work(oy(1)+j-1) = dble ( j - 1 )
+  end do
+
+  do l = 2, levels
+    do i = 1, mg(l)
+      work(ox(l)+i-1) = work(ox(l-1)+min(2*i-1,mg(l-1))-1)
+    end do
+    do j = 1, ng(l)
+      work(oy(l)+j-1) = work(oy(l-1)+min(2*j-1,ng(l-1))-1)
+    end do
+  end do
+
+  do l = 1, levels
+    call multigrid_line ( mg(l), work(ox(l)) )
+    call multigrid_line ( ng(l), work(oy(l)) )
+  end do
+!
+!  The finest grid works on a copy of W, so the change can be measured.
+!
+  call region_fork ( 'multigrid_copy' // c_null_char )
+!$omp parallel shared ( w, work ) private ( i, j )
+
+  call region_start ( )
+
+  !$omp do schedule ( static )
+  do j = 1, n
+    do i = 1, m
+      work(ou(1)+(i-1)+(j-1)*m) = w(i,j)
+      work(of(1)+(i-1)+(j-1)*m) = 0.0D+00
+    end do
+  end do
+  !$omp end do nowait
+  call region_work ( 'multigrid_copy' // c_null_char )
+  !$omp barrier
+  call region_wait ( 'multigrid_copy' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  do l = 1, levels - 1
+    call multigrid_smooth ( mg(l), ng(l), work(ox(l)), work(oy(l)), &
+      work(ou(l)), work(of(l)), sweeps_pre )
+    call multigrid_restrict ( mg(l), ng(l), work(ox(l)), work(oy(l)), &
+      work(ou(l)), work(of(l)), work(size-m*n+1), mg(l+1), ng(l+1), &
+      work(of(l+1)), work(ou(l+1)) )
+  end do
+
+  l = levels
+  call multigrid_smooth ( mg(l), ng(l), work(ox(l)), work(oy(l)), &
+    work(ou(l)), work(of(l)), 2 * ( mg(l) + ng(l) ) )
+
+  do l = levels - 1, 1, -1
+    call multigrid_prolong ( mg(l+1), ng(l+1), work(ox(l+1)), &
+      work(oy(l+1)), work(ou(l+1)), mg(l), ng(l), work(ox(l)), work(oy(l)), &
+      work(ou(l)) )
+    call multigrid_smooth ( mg(l), ng(l), work(ox(l)), work(oy(l)), &
+      work(ou(l)), work(of(l)), sweeps_post )
+  end do
+
+  diff = 0.0D+00
+
+  call region_fork ( 'multigrid_reduction' // c_null_char )
+!$omp parallel shared ( w, work ) private ( i, j )
+
+  call region_start ( )
+
+  !$omp do schedule ( static ) reduction ( max : diff )
+  do j = 1, n
+    do i = 1, m
+      diff = max ( diff, abs ( work(ou(1)+(i-1)+(j-1)*m) - w(i,j) ) )
+      w(i,j) = work(ou(1)+(i-1)+(j-1)*m)
+    end do
+  end do
+  !$omp end do nowait
+  call region_work ( 'multigrid_reduction' // c_null_char )
+  !$omp barrier
+  call region_wait ( 'multigrid_reduction' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  return
+end
+subroutine numa_report ( )
+
+!*****************************************************************************80
+!
+!! NUMA_REPORT prints how much of the process memory is on each NUMA node.
+!
+!  Discussion:
+!
+!    The counts are the N<node>=<pages> fields of /proc/self/numa_maps,
+!    times the page size of each mapping, summed over all mappings.
+!    Linux places a page on the node of the thread that first writes it,
+!    so a parallel run on a multi-socket node should show the arrays
+!    spread over the nodes of its threads.
+!
+!  Parameters:
+!
+!    None
+!
+  implicit none
+
+  integer ( kind = 4 ), parameter :: node_max = 64
+
+  integer ( kind = 4 ) e
+  integer ( kind = 4 ) ios
+  integer ( kind = 4 ) k
+  integer ( kind = 8 ) kb(0:node_max-1)
+  character ( len = 4096 ) line
+  integer ( kind = 4 ) node
+  integer ( kind = 8 ) page_kb
+  integer ( kind = 8 ) pages
+  integer ( kind = 4 ) s
+  integer ( kind = 4 ) unit
+
+  open ( newunit = unit, file = '/proc/self/numa_maps', status = 'old', &
+    action = 'read', iostat = ios )
+  if ( ios /= 0 ) then
+    write ( *, '(a)' ) '  NUMA_REPORT: /proc/self/numa_maps is not available.'
+    return
+  end if
+
+  kb(0:node_max-1) = 0
+
+  do
+
+    read ( unit, '(a)', iostat = ios ) line
+    if ( ios /= 0 ) then
+      exit
+    end if
+
+    page_kb = 4
+    k = index ( line, ' kernelpagesize_kB=' )
+    if ( 0 < k ) then
+      read ( line(k+19:), *, iostat = ios ) page_kb
+    end if
+!
+!  Each field " N<node>=<pages>".
+!
+    s = 1
+    do
+      k = index ( line(s:), ' N' )
+      if ( k == 0 ) then
+        exit
+      end if
+      s = s + k
+      e = index ( line(s:), '=' )
+      if ( e < 3 ) then
+        cycle
+      end if
+      read ( line(s+1:s+e-2), *, iostat = ios ) node
+      if ( ios /= 0 .or. node < 0 .or. node_max <= node ) then
+        cycle
+      end if
+      k = index ( line(s+e:), ' ' )
+      read ( line(s+e:s+e+k-2), *, iostat = ios ) pages
+      if ( ios == 0 ) then
+        kb(node) = kb(node) + pages * page_kb
+      end if
+    end do
+
+  end do
+
+  close ( unit )
+
+  write ( *, '(a)' ) ' '
+  write ( *, '(a)' ) '  Memory on each NUMA node:'
+  do node = 0, node_max - 1
+    if ( 0 < kb(node) ) then
+      write ( *, '(a,i4,a,f12.1,a)' ) '    Node ', node, ': ', &
+        real ( kb(node), kind = 8 ) / 1024.0D+00, ' MiB'
+    end if
+  end do
+
+  return
+end
+subroutine option_get ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET returns the value of a run time option.
+!
+!  Discussion:
+!
+!    The option NAME may be given on the command line as NAME=VALUE, or
+!    in the environment variable ENV_NAME.  The command line takes
+!    precedence.  If the option is not given, VALUE is unchanged.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, character ( len = * ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = 255 ) arg
+  character ( len = * ) env_name
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) k
+  integer ( kind = 4 ) length
+  character ( len = * ) name
+  integer ( kind = 4 ) status
+  character ( len = * ) value
+
+  do i = 1, command_argument_count ( )
+    call get_command_argument ( i, arg )
+    k = index ( arg, '=' )
+    if ( 1 < k ) then
+      if ( arg(1:k-1) == name ) then
+        value = arg(k+1:)
+        return
+      end if
+    end if
+  end do
+
+  call get_environment_variable ( env_name, arg, length, status )
+  if ( status == 0 .and. 0 < length ) then
+    value = arg
+  end if
+
+  return
+end
+subroutine option_get_i4 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_I4 returns the value of an integer run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, integer ( kind = 4 ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  integer ( kind = 4 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_I4 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      stop 1
+    end if
+  end if
+
+  return
+end
+subroutine option_get_r8 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_R8 returns the value of a real run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, real ( kind = 8 ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  real ( kind = 8 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_R8 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      stop 1
+    end if
+  end if
+
+  return
+end
+subroutine placement_report ( )
+
+!*****************************************************************************80
+!
+!! PLACEMENT_REPORT prints the OpenMP place each thread is bound to.
+!
+!  Discussion:
+!
+!    Unbound threads can migrate, and a thread that moves to another
+!    socket finds its part of the grid in remote memory.  For MPI runs,
+!    mpi_examples/fortran_c_codes/layout reports ranks as well.
+!
+!  Parameters:
+!
+!    None
+!
+  use omp_lib
+
+  implicit none
+
+  integer ( kind = 4 ), allocatable :: ids(:)
+  integer ( kind = 4 ) num_places
+  integer ( kind = 4 ) place
+  integer ( kind = omp_proc_bind_kind ) proc_bind
+  integer ( kind = 4 ) thread
+
+  num_places = omp_get_num_places ( )
+  proc_bind = omp_get_proc_bind ( )
+
+  if ( num_places == 0 .or. proc_bind == omp_proc_bind_false ) then
+    write ( *, '(a)' ) &
+      '  Threads are not bound; set OMP_PLACES and OMP_PROC_BIND.'
+    return
+  end if
+
+  write ( *, '(a,i6)' ) '  The number of OpenMP places = ', num_places
+
+!$omp parallel private ( ids, place, thread )
+
+  thread = omp_get_thread_num ( )
+  place = omp_get_place_num ( )
+  allocate ( ids(max ( 1, omp_get_place_num_procs ( place ) )) )
+  call omp_get_place_proc_ids ( place, ids )
+
+!$omp critical
+  write ( *, '(a,i4,a,i4,a,*(1x,i0))' ) '  Thread ', thread, &
+    ' is bound to place ', place, ', CPUs', &
+    ids(1:omp_get_place_num_procs ( place ))
+!$omp end critical
+
+  deallocate ( ids )
+
+!$omp end parallel
+
+  return
+end
+subroutine sor_redblack ( m, n, omega, w, diff )
+
+!*****************************************************************************80
+!
+!! SOR_REDBLACK carries out one red-black SOR iteration.
+!
+!  Discussion:
+!
+!    Node (I,J) is red if I+J is even, and black otherwise.  The red
+!    nodes are updated first, and then the black nodes, using the red
+!    values just computed.  With OMEGA = 1, this is Gauss-Seidel.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) M, N, the size of the grid.
+!
+!    Input, real ( kind = 8 ) OMEGA, the relaxation factor, between 0 and 2.
+!
+!    Input/output, real ( kind = 8 ) W(M,N), the solution.
+!
+!    Output, real ( kind = 8 ) DIFF, the largest change in the solution.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) m
+  integer ( kind = 4 ) n
+
+  integer ( kind = 4 ) color
+  real ( kind = 8 ) diff
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  real ( kind = 8 ) omega
+  real ( kind = 8 ) w(m,n)
+  real ( kind = 8 ) w_new
+
+  diff = 0.0D+00
+
+  call region_fork ( 'sor_redblack' // c_null_char )
+!$omp parallel shared ( diff, omega, w ) private ( color, i, j, w_new )
+
+  call region_start ( )
+
+  do color = 0, 1
+
+    !$omp do schedule ( static ) reduction ( max : diff )
+    do j = 2, n - 1
+      do i = 2 + mod ( j + color, 2 ), m - 1, 2
+        w_new = ( 1.0D+00 - omega ) * w(i,j) &
+          + omega * 0.25D+00 * ( w(i-1,j) + w(i+1,j) + w(i,j-1) + w(i,j+1) )
+        diff = max ( diff, abs ( w_new - w(i,j) ) )
+        w(i,j) = w_new
+      end do
+    end do
+    !$omp end do nowait
+    call region_work ( 'sor_redblack' // c_null_char )
+    !$omp barrier
+    call region_wait ( 'sor_redblack' // c_null_char )
+
+  end do
+
+!$omp end parallel
+  call region_join ( )
+
+  return
 end
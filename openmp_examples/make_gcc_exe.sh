@@ -1,80 +1,27 @@
 #!/bin/bash
 #
-#  Compile the programs with GCC.
+#  Compile the programs with GCC, then time them with benchmark.py.
+#
+#  Options after the script name are passed on to benchmark.py, e.g.
+#
+#    ./make_gcc_exe.sh --threads 1,2,4,8,16,20 --trials 3 --csv bench.csv
+#
+#  The script stops at the first failed step, so that a compile error
+#  does not go on to time old binaries.  fft_openmp.cpp is a tar archive,
+#  not a source file, so it is not compiled.
 #
 module load gcc
-g++ -O3 -fopenmp -o fft_openmp_cpp fft_openmp.cpp -lm
-gfortran -O3 -fopenmp -o heated_plate_f90 heated_plate_openmp.f90 -lm
-gfortran -O3 -fopenmp -o  md_f90  md_openmp.f90 -lm
-gcc -O3 -fopenmp -o pi_red pi_red.c 
-
-echo 'pi calculation'
-code=pi_red
-export OMP_DYNAMIC=FALSE
-export OMP_NUM_THREADS=1
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=2
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=4
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=8
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=16
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=20
-time ./$code >& $code.$OMP_NUM_THREADS
-
-
-echo 'DFT'
-code=heated_plate_f90
-
-export OMP_DYNAMIC=FALSE
-export OMP_NUM_THREADS=1
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=2
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=4
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=8
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=16
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=20
-time ./$code >& $code.$OMP_NUM_THREADS
-
-echo 'MD'
-
-code=md_f90
-
-export OMP_DYNAMIC=FALSE
-export OMP_NUM_THREADS=1
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=2
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=4
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=8
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=16
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=20
-time ./$code >& $code.$OMP_NUM_THREADS
-
-echo 'FFT'
-code=fft_openmp_cpp
-
-export OMP_DYNAMIC=FALSE
-export OMP_NUM_THREADS=1
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=2
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=4
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=8
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=16
-time ./$code >& $code.$OMP_NUM_THREADS
-export OMP_NUM_THREADS=20
-time ./$code >& $code.$OMP_NUM_THREADS
-
-
+set -e
+cd "$(dirname "$0")"
+gcc -O3 -fopenmp -c async_io.c
+gcc -O3 -fopenmp -c omp_regions.c
+gfortran -O3 -fopenmp -o heated_plate_f90 heated_plate_openmp.f90 async_io.o \
+  omp_regions.o -lm -lpthread
+gcc -O3 -fopenmp -DHAVE_ZLIB -c trajectory.c
+gfortran -O3 -march=native -fopenmp -o  md_f90  md_openmp.f90 trajectory.o \
+  async_io.o omp_regions.o -lz -lm -lpthread
+gcc -O3 -fopenmp -o pi_red pi_red.c
+mpif90 -O3 -fopenmp -o ../mpi_examples/fortran_c_codes/pi_mpi/pi_mpi \
+  ../mpi_examples/fortran_c_codes/pi_mpi/pi_mpi.f90
+
+python3 benchmark.py "$@"
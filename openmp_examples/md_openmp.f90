@@ -1,3 +1,44 @@
+module omp_regions
+
+!*****************************************************************************80
+!
+!! OMP_REGIONS declares the OpenMP region timers of omp_regions.c.
+!
+!  Discussion:
+!
+!    See omp_regions.h for how a parallel region and its loops are
+!    marked.  The names are C strings, as in 'jacobi' // c_null_char.
+!
+  use iso_c_binding
+
+  implicit none
+
+  interface
+    subroutine region_fork ( name ) bind ( c )
+      import c_char
+      character ( kind = c_char ) name(*)
+    end subroutine region_fork
+    subroutine region_join ( ) bind ( c )
+    end subroutine region_join
+    subroutine region_start ( ) bind ( c )
+    end subroutine region_start
+    subroutine region_wait ( name ) bind ( c )
+      import c_char
+      character ( kind = c_char ) name(*)
+    end subroutine region_wait
+    subroutine region_work ( name ) bind ( c )
+      import c_char
+      character ( kind = c_char ) name(*)
+    end subroutine region_work
+    subroutine regions_init ( enabled ) bind ( c )
+      import c_int
+      integer ( kind = c_int ), value :: enabled
+    end subroutine regions_init
+    subroutine regions_report ( ) bind ( c )
+    end subroutine regions_report
+  end interface
+
+end module omp_regions
 program main
 
 !*****************************************************************************80
@@ -14,6 +55,90 @@ program main
 !
 !    The particles interact with a central pair potential.
 !
+!    The number of particles NP, the number of time steps STEP_NUM, the
+!    time step DT, the side of the box BOX, and the options below may be
+!    set on the command line, as in
+!
+!      md_f90 np=100000 box=46.4 step_num=100 force=neighbor
+!
+!    or by the environment variables MD_NP, MD_STEP_NUM, MD_DT, MD_BOX,
+!    MD_FORCE, and so on.  The command line takes precedence.
+!
+!    The option FORCE selects how forces are computed:
+!
+!      ALLPAIRS, the default, visits all NP*(NP-1) particle pairs;
+!
+!      NEIGHBOR uses a linked-cell build of a Verlet neighbor list whose
+!      cutoff is PI2 plus a skin, rebuilt only when some particle has moved
+!      more than half the skin since the last build.  The work per step
+!      is then proportional to NP.  The skin width may be set with SKIN.
+!
+!    The option PAIRS selects how pairs are visited:
+!
+!      FULL, the default, evaluates each pair twice, once for each of its
+!      particles, so that each thread only writes the forces it owns;
+!
+!      HALF evaluates each pair once and applies the force with opposite
+!      signs to both particles, following Newton's third law.  Each thread
+!      accumulates into its own copy of the force array, and the copies are
+!      summed in parallel at the end.
+!
+!    Every array is first written by the same static partition of the
+!    particles over the threads that later computes on it, so that on a
+!    NUMA system each thread's particles live in its own node's memory.
+!    The positions come from a seeded LCG that each thread skips ahead to
+!    its own particles, so they do not depend on the number of threads.
+!    NUMA_REPORT=yes prints how the process memory is spread over the
+!    NUMA nodes at the end of the run.
+!
+!    The option LAYOUT selects how the particles are stored:
+!
+!      AOS, the default, stores POS(ND,NP) and so on, so that the ND
+!      coordinates of a particle are adjacent;
+!
+!      SOA stores POS(NP_PAD,ND), so that each coordinate of all particles
+!      is a column, NP_PAD being NP rounded up to a multiple of 8, so
+!      that the update loops over whole columns need no remainder for
+!      vectors of up to 8 doubles.  The columns are not known to be
+!      aligned, so the vector loops do not assume it.  The force loop
+!      over the partners J of a particle is vectorized, with a
+!      polynomial sine and cosine.  SOA is only available with
+!      FORCE=ALLPAIRS and PAIRS=FULL.
+!
+!    CHECKPOINT=K saves the state of the run to CHECKPOINT_FILE (default
+!    md.ckpt) every K steps, and RESTART=yes resumes from that file, with
+!    the same or a larger STEP_NUM.  The checkpoint is raw binary: eight
+!    64 bit integers, the magic number "MDCHECKP", NP, the leading
+!    dimension of the arrays, the step, 1 for LAYOUT=SOA or 0, the number
+!    of neighbor list builds, and two 0s; then the initial energy E0; then
+!    POS, VEL, ACC and POS_REF.  The arrays are copied into a buffer, and
+!    a background thread (see async_io.c) writes them while the steps go
+!    on.  With the same options and number of threads, the resumed run
+!    carries out exactly the same arithmetic as an uninterrupted one, as
+!    every force loop divides the particles statically among the threads;
+!    in NEIGHBOR mode, the list is rebuilt from POS_REF.  The energies
+!    summed by REDUCTION clauses may still differ in the last bit, since
+!    the order in which the threads' sums are combined is unspecified,
+!    but they do not feed back into the motion.
+!
+!    TRAJECTORY=K writes the positions and velocities of step 0 and of
+!    every K-th step to TRAJECTORY_FILE (default md.traj), in the binary
+!    format described in trajectory.h.  TRAJECTORY_QUANTUM=Q rounds the
+!    values to multiples of Q, which are stored as variable length
+!    differences from the previous frame; by default the doubles are kept
+!    exactly, as the XOR of their bits with the previous frame.  With
+!    TRAJECTORY_COMPRESS=yes, the default, the frames are then compressed
+!    with zlib.  The steps only copy the arrays; a background thread
+!    encodes, compresses and writes the frames.  After a restart, frames
+!    are appended to the file, so the steps between the checkpoint and
+!    the interruption appear twice.
+!
+!    PROFILE=yes times each parallel region, and each loop in it, on every
+!    thread, with the markers of omp_regions.c, and prints at the end how
+!    long the threads were busy, how unevenly, how long they waited at
+!    the barrier ending each loop, and how long the team took to start
+!    and end.
+!
 !  Licensing:
 !
 !    This code is distributed under the GNU LGPL license. 
@@ -27,32 +152,127 @@ program main
 !    Original FORTRAN90 version by Bill Magro.
 !    This FORTRAN90 version by John Burkardt.
 !
+  use iso_c_binding
   use omp_lib
+  use omp_regions
 
   implicit none
 
+  interface
+    function async_io_create ( ) bind ( c )
+      import c_ptr
+      type ( c_ptr ) async_io_create
+    end function async_io_create
+    subroutine async_io_begin ( io, path ) bind ( c )
+      import c_char, c_ptr
+      type ( c_ptr ), value :: io
+      character ( kind = c_char ) path(*)
+    end subroutine async_io_begin
+    subroutine async_io_append ( io, data, bytes ) bind ( c )
+      import c_ptr, c_size_t
+      type ( c_ptr ), value :: io
+      type ( * ) data(*)
+      integer ( kind = c_size_t ), value :: bytes
+    end subroutine async_io_append
+    subroutine async_io_commit ( io ) bind ( c )
+      import c_ptr
+      type ( c_ptr ), value :: io
+    end subroutine async_io_commit
+    function async_io_wait ( io ) bind ( c )
+      import c_int, c_ptr
+      type ( c_ptr ), value :: io
+      integer ( kind = c_int ) async_io_wait
+    end function async_io_wait
+    subroutine async_io_get_stats ( io, stats ) bind ( c )
+      import c_double, c_ptr
+      type ( c_ptr ), value :: io
+      real ( kind = c_double ) stats(5)
+    end subroutine async_io_get_stats
+    subroutine async_io_destroy ( io ) bind ( c )
+      import c_ptr
+      type ( c_ptr ), value :: io
+    end subroutine async_io_destroy
+    function trajectory_close ( t, stats ) bind ( c )
+      import c_double, c_int, c_ptr
+      type ( c_ptr ), value :: t
+      real ( kind = c_double ) stats(6)
+      integer ( kind = c_int ) trajectory_close
+    end function trajectory_close
+    function trajectory_open ( path, np, nd, quantum, compress, append ) &
+      bind ( c )
+      import c_char, c_double, c_int, c_ptr
+      character ( kind = c_char ) path(*)
+      integer ( kind = c_int ), value :: np
+      integer ( kind = c_int ), value :: nd
+      real ( kind = c_double ), value :: quantum
+      integer ( kind = c_int ), value :: compress
+      integer ( kind = c_int ), value :: append
+      type ( c_ptr ) trajectory_open
+    end function trajectory_open
+    subroutine trajectory_write ( t, step, pos, vel, ld, soa ) bind ( c )
+      import c_double, c_int, c_ptr
+      type ( c_ptr ), value :: t
+      integer ( kind = c_int ), value :: step
+      real ( kind = c_double ) pos(*)
+      real ( kind = c_double ) vel(*)
+      integer ( kind = c_int ), value :: ld
+      integer ( kind = c_int ), value :: soa
+    end subroutine trajectory_write
+  end interface
+
   integer ( kind = 4 ), parameter :: nd = 3
-  integer ( kind = 4 ), parameter :: np = 1000
 
-  real ( kind = 8 ) acc(nd,np)
+  real ( kind = 8 ), allocatable :: acc(:,:)
   real ( kind = 8 ) box(nd)
-  real ( kind = 8 ), parameter :: dt = 0.0001D+00
+  real ( kind = 8 ) :: box_side = 10.0D+00
+  integer ( kind = 4 ) :: checkpoint = 0
+  character ( len = 255 ) checkpoint_file
+  type ( c_ptr ) checkpoint_io
+  real ( kind = 8 ) checkpoint_stats(5)
+  real ( kind = 8 ) :: dt = 0.0001D+00
   real ( kind = 8 ) e0
-  real ( kind = 8 ) force(nd,np)
-  integer ( kind = 4 ) id
+  real ( kind = 8 ), allocatable :: force(:,:)
+  character ( len = 255 ) force_mode
+  real ( kind = 8 ), allocatable :: force_thread(:,:,:)
+  logical half
+  integer ( kind = 4 ) j
   real ( kind = 8 ) kinetic
+  character ( len = 255 ) layout_mode
   real ( kind = 8 ), parameter :: mass = 1.0D+00
-  real ( kind = 8 ) pos(nd,np)
+  integer ( kind = 4 ) nbr_build_num
+  integer ( kind = 4 ), allocatable :: nbr_first(:)
+  integer ( kind = 4 ), allocatable :: nbr_list(:)
+  integer ( kind = 4 ) nbr_max
+  integer ( kind = 4 ) nbr_num
+  integer ( kind = 4 ) :: np = 1000
+  integer ( kind = 4 ) np_pad
+  character ( len = 255 ) numa_mode
+  character ( len = 255 ) pairs_mode
+  real ( kind = 8 ), parameter :: PI2 = 3.141592653589793D+00 / 2.0D+00
+  real ( kind = 8 ), allocatable :: pos(:,:)
+  real ( kind = 8 ), allocatable :: pos_ref(:,:)
   real ( kind = 8 ) potential
   integer ( kind = 4 ) proc_num
+  character ( len = 255 ) profile
+  character ( len = 255 ) restart
   integer ( kind = 4 ) seed
+  real ( kind = 8 ) :: skin = 0.3D+00
+  logical soa
   integer ( kind = 4 ) step
-  integer ( kind = 4 ), parameter :: step_num = 400
+  integer ( kind = 4 ) step_first
+  integer ( kind = 4 ) :: step_num = 400
   integer ( kind = 4 ) step_print
   integer ( kind = 4 ) step_print_index
   integer ( kind = 4 ) step_print_num
   integer ( kind = 4 ) thread_num
-  real ( kind = 8 ) vel(nd,np)
+  integer ( kind = 4 ) :: trajectory = 0
+  character ( len = 255 ) trajectory_compress
+  character ( len = 255 ) trajectory_file
+  type ( c_ptr ) :: trajectory_out = c_null_ptr
+  real ( kind = 8 ) :: trajectory_quantum = 0.0D+00
+  real ( kind = 8 ) trajectory_stats(6)
+  real ( kind = 8 ) trajectory_wait
+  real ( kind = 8 ), allocatable :: vel(:,:)
   real ( kind = 8 ) wtime
 
   call timestamp ( )
@@ -60,6 +280,105 @@ program main
   proc_num = omp_get_num_procs ( )
   thread_num = omp_get_max_threads ( )
 
+  call option_get_i4 ( 'np', 'MD_NP', np )
+  call option_get_i4 ( 'step_num', 'MD_STEP_NUM', step_num )
+  call option_get_r8 ( 'dt', 'MD_DT', dt )
+  call option_get_r8 ( 'box', 'MD_BOX', box_side )
+
+  if ( np < 2 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'MD_OPENMP - Fatal error!'
+    write ( *, '(a)' ) '  NP must be at least 2.'
+    stop 1
+  end if
+
+  force_mode = 'allpairs'
+  call option_get ( 'force', 'MD_FORCE', force_mode )
+  if ( force_mode /= 'allpairs' .and. force_mode /= 'neighbor' ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'MD_OPENMP - Fatal error!'
+    write ( *, '(a,a)' ) '  Unknown FORCE = ', trim ( force_mode )
+    stop 1
+  end if
+  pairs_mode = 'full'
+  call option_get ( 'pairs', 'MD_PAIRS', pairs_mode )
+  if ( pairs_mode /= 'full' .and. pairs_mode /= 'half' ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'MD_OPENMP - Fatal error!'
+    write ( *, '(a,a)' ) '  Unknown PAIRS = ', trim ( pairs_mode )
+    stop 1
+  end if
+  half = ( pairs_mode == 'half' )
+
+  call option_get_r8 ( 'skin', 'MD_SKIN', skin )
+
+  layout_mode = 'aos'
+  call option_get ( 'layout', 'MD_LAYOUT', layout_mode )
+  if ( layout_mode /= 'aos' .and. layout_mode /= 'soa' ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'MD_OPENMP - Fatal error!'
+    write ( *, '(a,a)' ) '  Unknown LAYOUT = ', trim ( layout_mode )
+    stop 1
+  end if
+  soa = ( layout_mode == 'soa' )
+  if ( soa .and. ( force_mode /= 'allpairs' .or. half ) ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'MD_OPENMP - Fatal error!'
+    write ( *, '(a)' ) '  LAYOUT=SOA needs FORCE=ALLPAIRS and PAIRS=FULL.'
+    stop 1
+  end if
+  np_pad = 8 * ( ( np + 7 ) / 8 )
+
+  call option_get_i4 ( 'checkpoint', 'MD_CHECKPOINT', checkpoint )
+  checkpoint_file = 'md.ckpt'
+  call option_get ( 'checkpoint_file', 'MD_CHECKPOINT_FILE', &
+    checkpoint_file )
+  restart = 'no'
+  call option_get ( 'restart', 'MD_RESTART', restart )
+
+  call option_get_i4 ( 'trajectory', 'MD_TRAJECTORY', trajectory )
+  trajectory_file = 'md.traj'
+  call option_get ( 'trajectory_file', 'MD_TRAJECTORY_FILE', &
+    trajectory_file )
+  call option_get_r8 ( 'trajectory_quantum', 'MD_TRAJECTORY_QUANTUM', &
+    trajectory_quantum )
+  trajectory_compress = 'yes'
+  call option_get ( 'trajectory_compress', 'MD_TRAJECTORY_COMPRESS', &
+    trajectory_compress )
+
+  numa_mode = 'no'
+  call option_get ( 'numa_report', 'MD_NUMA_REPORT', numa_mode )
+
+  profile = 'no'
+  call option_get ( 'profile', 'MD_PROFILE', profile )
+  call regions_init ( merge ( 1, 0, profile == 'yes' ) )
+
+  if ( soa ) then
+    allocate ( acc(np_pad,nd) )
+    allocate ( force(np_pad,nd) )
+    allocate ( pos(np_pad,nd) )
+    allocate ( pos_ref(nd,0) )
+    allocate ( vel(np_pad,nd) )
+  else
+    allocate ( acc(nd,np) )
+    allocate ( force(nd,np) )
+    allocate ( pos(nd,np) )
+    allocate ( pos_ref(nd,np) )
+    allocate ( vel(nd,np) )
+!
+!  First touch FORCE and POS_REF with the static partition over particles
+!  that the force and update loops use, so that on a NUMA system each
+!  thread's particles are in its own node's memory.  INITIALIZE does the
+!  same for POS, VEL and ACC, and INITIALIZE_SOA for all SOA arrays.
+!
+!$omp parallel do schedule ( static )
+    do j = 1, np
+      force(1:nd,j) = 0.0D+00
+      pos_ref(1:nd,j) = 0.0D+00
+    end do
+!$omp end parallel do
+  end if
+
   write ( *, '(a)' ) ' '
   write ( *, '(a)' ) 'MD_OPENMP'
   write ( *, '(a)' ) '  FORTRAN90/OpenMP version'
@@ -70,13 +389,46 @@ program main
     '  NP, the number of particles in the simulation is ', np
   write ( *, '(a,i8)' ) '  STEP_NUM, the number of time steps, is ', step_num
   write ( *, '(a,g14.6)' ) '  DT, the size of each time step, is ', dt
+  write ( *, '(a,g14.6)' ) '  BOX, the side of the box, is ', box_side
+  write ( *, '(a,a)' ) '  FORCE, the force computation, is ', &
+    trim ( force_mode )
+  if ( force_mode == 'neighbor' ) then
+    write ( *, '(a,g14.6)' ) '  SKIN, the neighbor list skin, is ', skin
+  end if
+  write ( *, '(a,a)' ) '  PAIRS, the pair evaluation, is ', &
+    trim ( pairs_mode )
+  write ( *, '(a,a)' ) '  LAYOUT, the particle storage, is ', &
+    trim ( layout_mode )
+  if ( 0 < checkpoint ) then
+    write ( *, '(a,i8,a,a)' ) '  Checkpoint every ', checkpoint, &
+      ' steps to ', trim ( checkpoint_file )
+    checkpoint_io = async_io_create ( )
+  end if
+  if ( 0 < trajectory ) then
+    write ( *, '(a,i8,a,a)' ) '  Trajectory every ', trajectory, &
+      ' steps to ', trim ( trajectory_file )
+    if ( 0.0D+00 < trajectory_quantum ) then
+      write ( *, '(a,g14.6)' ) '  quantized to multiples of ', &
+        trajectory_quantum
+    end if
+    trajectory_out = trajectory_open ( &
+      trim ( trajectory_file ) // c_null_char, np, nd, trajectory_quantum, &
+      merge ( 1, 0, trajectory_compress == 'yes' ), &
+      merge ( 1, 0, restart == 'yes' ) )
+    if ( .not. c_associated ( trajectory_out ) ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'MD_OPENMP - Fatal error!'
+      write ( *, '(a,a)' ) '  Cannot write ', trim ( trajectory_file )
+      stop 1
+    end if
+  end if
   write ( *, '(a)' ) ' '
   write ( *, '(a,i8)' ) '  The number of processors available is: ', proc_num
   write ( *, '(a,i8)' ) '  The number of threads available is:    ', thread_num
 !
 !  Set the dimensions of the box.
 !
-  box(1:nd) = 10.0D+00
+  box(1:nd) = box_side
 !
 !  Set initial positions, velocities, and accelerations.
 !
@@ -84,38 +436,76 @@ program main
   write ( *, '(a)' ) '  Initializing positions, velocities, and accelerations.'
 
   seed = 123456789
-  call initialize ( np, nd, box, seed, pos, vel, acc )
+  if ( soa ) then
+    call initialize_soa ( np, np_pad, nd, box, seed, pos, vel, acc, force )
+  else
+    call initialize ( np, nd, box, seed, pos, vel, acc )
+  end if
+!
+!  The neighbor list starts out empty, so the first force evaluation
+!  builds it.
+!
+  nbr_build_num = 0
+  nbr_max = 0
+  nbr_num = 0
+  allocate ( nbr_first(np+1) )
+  allocate ( nbr_list(nbr_max) )
+!
+!  Each thread gets its own force array for HALF pair evaluation.
+!
+  if ( half ) then
+    allocate ( force_thread(nd,np,0:thread_num-1) )
+  else
+    allocate ( force_thread(nd,np,0) )
+  end if
+
+  if ( restart == 'yes' ) then
+
+    call checkpoint_read ( )
+
+  else
 !
 !  Compute the forces and energies.
 !
-  write ( *, '(a)' ) ' '
-  write ( *, '(a)' ) '  Computing initial forces and energies.'
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) '  Computing initial forces and energies.'
 
-  call compute ( np, nd, pos, vel, mass, force, potential, kinetic )
+    call forces ( )
 !
 !  Save the initial total energy for use in the accuracy check.
 !
-  e0 = potential + kinetic
+    e0 = potential + kinetic
+
+    step = 0
+    write ( *, '(2x,i8,2x,g14.6,2x,g14.6,2x,g14.6)' ) &
+      step, potential, kinetic, ( potential + kinetic - e0 ) / e0
+
+    if ( 0 < trajectory ) then
+      call trajectory_write ( trajectory_out, step, pos, vel, size ( pos, 1 ), &
+        merge ( 1, 0, soa ) )
+    end if
+
+  end if
 !
 !  This is the main time stepping loop:
 !    Compute forces and energies,
 !    Update positions, velocities, accelerations.
 !
+  step_first = step + 1
+
   step_print = 0
   step_print_index = 0
   step_print_num = 10
-  
-  step = 0
-  write ( *, '(2x,i8,2x,g14.6,2x,g14.6,2x,g14.6)' ) &
-    step, potential, kinetic, ( potential + kinetic - e0 ) / e0
-  step_print_index = step_print_index + 1
-  step_print = ( step_print_index * step_num ) / step_print_num
+  do while ( step_print <= step )
+    step_print_index = step_print_index + 1
+    step_print = ( step_print_index * step_num ) / step_print_num
+  end do
 
   wtime = omp_get_wtime ( )
 
-  do step = 1, step_num
+  do step = step_first, step_num
 
-    call compute ( np, nd, pos, vel, mass, force, potential, kinetic )
+    call forces ( )
 
     if ( step == step_print ) then
 
@@ -127,7 +517,24 @@ program main
 
     end if
 
-    call update ( np, nd, pos, vel, force, acc, mass, dt )
+    if ( soa ) then
+      call update_soa ( np_pad, nd, pos, vel, force, acc, mass, dt )
+    else
+      call update ( np, nd, pos, vel, force, acc, mass, dt )
+    end if
+
+    if ( 0 < trajectory ) then
+      if ( mod ( step, trajectory ) == 0 ) then
+        call trajectory_write ( trajectory_out, step, pos, vel, &
+          size ( pos, 1 ), merge ( 1, 0, soa ) )
+      end if
+    end if
+
+    if ( 0 < checkpoint ) then
+      if ( mod ( step, checkpoint ) == 0 ) then
+        call checkpoint_write ( )
+      end if
+    end if
 
   end do
 
@@ -135,6 +542,60 @@ program main
   write ( *, '(a)' ) ' '
   write ( *, '(a)' ) '  Elapsed time for main computation:'
   write ( *, '(2x,g14.6,a)' ) wtime, ' seconds'
+
+  if ( 0 < checkpoint ) then
+    j = async_io_wait ( checkpoint_io )
+    call async_io_get_stats ( checkpoint_io, checkpoint_stats )
+    call async_io_destroy ( checkpoint_io )
+    write ( *, '(a,i8,a,f10.3,a,f10.3,a)' ) '  Checkpoints: ', &
+      int ( checkpoint_stats(1) ), ', written in ', checkpoint_stats(3), &
+      ' s in the background, steps stalled ', checkpoint_stats(4), ' s'
+  end if
+
+  if ( c_associated ( trajectory_out ) ) then
+    trajectory_wait = omp_get_wtime ( )
+    j = trajectory_close ( trajectory_out, trajectory_stats )
+    trajectory_wait = omp_get_wtime ( ) - trajectory_wait
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,i8,a,f12.1,a,f12.1,a)' ) '  Trajectory: ', &
+      int ( trajectory_stats(1) ), ' frames, ', &
+      trajectory_stats(3) / 1.0D+06, ' MB for ', &
+      trajectory_stats(2) / 1.0D+06, ' MB of doubles'
+    write ( *, '(a,f10.3,a,f10.3,a)' ) '    encoded in ', &
+      trajectory_stats(4), ' s and written in ', trajectory_stats(5), &
+      ' s by the writer thread'
+    write ( *, '(a,f10.3,a,f10.3,a,f6.2,a,f10.3,a)' ) '    steps spent ', &
+      trajectory_stats(6), ' s of ', wtime, ' s (', &
+      100.0D+00 * trajectory_stats(6) / max ( wtime, 1.0D-09 ), &
+      '%) queuing frames, final wait ', trajectory_wait, ' s'
+    if ( 0 < j ) then
+      write ( *, '(a,i8,a)' ) '    ', j, ' frames could not be written.'
+    end if
+  end if
+
+  if ( force_mode == 'neighbor' ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,i8)' ) '  Neighbor list builds:          ', nbr_build_num
+    write ( *, '(a,i12)' ) '  Neighbor list entries:     ', nbr_num
+  end if
+
+  if ( numa_mode == 'yes' ) then
+    call numa_report ( )
+  end if
+
+  if ( profile == 'yes' ) then
+    flush ( 6 )
+    call regions_report ( )
+  end if
+
+  deallocate ( nbr_first )
+  deallocate ( nbr_list )
+  deallocate ( force_thread )
+  deallocate ( acc )
+  deallocate ( force )
+  deallocate ( pos )
+  deallocate ( pos_ref )
+  deallocate ( vel )
 !
 !  Terminate.
 !
@@ -146,6 +607,170 @@ program main
   call timestamp ( )
 
   stop
+contains
+  subroutine forces ( )
+
+!*****************************************************************************80
+!
+!! FORCES computes forces and energies with the selected method.
+!
+!  Discussion:
+!
+!    In NEIGHBOR mode, the list is rebuilt when a particle has moved more
+!    than SKIN/2 since the last build, since only then can a pair that was
+!    outside PI2 + SKIN have come within PI2.  If the list array is too
+!    small, it is enlarged and the build repeated.
+!
+    logical rebuild
+
+    if ( soa ) then
+
+      call compute_soa ( np, np_pad, nd, pos, vel, mass, force, potential, &
+        kinetic )
+
+    else if ( force_mode == 'neighbor' ) then
+
+      rebuild = ( nbr_build_num == 0 )
+      if ( .not. rebuild ) then
+        call neighbor_check ( np, nd, pos, pos_ref, skin, rebuild )
+      end if
+
+      if ( rebuild ) then
+        call neighbor_rebuild ( pos )
+        pos_ref(1:nd,1:np) = pos(1:nd,1:np)
+        nbr_build_num = nbr_build_num + 1
+      end if
+
+      if ( half ) then
+        call compute_neighbor_half ( np, nd, pos, vel, mass, nbr_first, &
+          nbr_list, thread_num, force_thread, force, potential, kinetic )
+      else
+        call compute_neighbor ( np, nd, pos, vel, mass, nbr_first, nbr_list, &
+          force, potential, kinetic )
+      end if
+
+    else if ( half ) then
+
+      call compute_half ( np, nd, pos, vel, mass, thread_num, force_thread, &
+        force, potential, kinetic )
+
+    else
+
+      call compute ( np, nd, pos, vel, mass, force, potential, kinetic )
+
+    end if
+
+    return
+  end subroutine forces
+  subroutine checkpoint_read ( )
+
+!*****************************************************************************80
+!
+!! CHECKPOINT_READ resumes the run from CHECKPOINT_FILE.
+!
+!  Discussion:
+!
+!    STEP is set to the last step done.  If the run that wrote the file
+!    had built a neighbor list, the list is rebuilt from POS_REF, so that
+!    it is the list that run was using.
+!
+    integer ( kind = 8 ) header(8)
+    integer ( kind = 4 ) ios
+    integer ( kind = 4 ) unit
+
+    open ( newunit = unit, file = checkpoint_file, status = 'old', &
+      access = 'stream', form = 'unformatted', action = 'read', &
+      iostat = ios )
+    if ( ios == 0 ) then
+      read ( unit, iostat = ios ) header, e0
+    end if
+    if ( ios == 0 ) then
+      if ( header(1) /= transfer ( 'MDCHECKP', 0_8 ) .or. &
+        header(2) /= np .or. header(3) /= size ( pos, 1 ) .or. &
+        header(5) /= merge ( 1, 0, soa ) .or. step_num < header(4) ) then
+        ios = -1
+      end if
+    end if
+    if ( ios == 0 ) then
+      read ( unit, iostat = ios ) pos, vel, acc, pos_ref
+    end if
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'MD_OPENMP - Fatal error!'
+      write ( *, '(a,a)' ) '  Cannot restart from ', trim ( checkpoint_file )
+      write ( *, '(a)' ) &
+        '  It is missing, damaged, past STEP_NUM, or for another NP or LAYOUT.'
+      stop 1
+    end if
+    close ( unit )
+
+    step = int ( header(4) )
+    nbr_build_num = int ( header(6) )
+
+    if ( force_mode == 'neighbor' .and. 0 < nbr_build_num ) then
+      call neighbor_rebuild ( pos_ref )
+    end if
+
+    write ( *, '(a)' ) ' '
+    write ( *, '(a,a,a,i8)' ) '  Restarted from ', trim ( checkpoint_file ), &
+      ' at step ', step
+
+    return
+  end subroutine checkpoint_read
+  subroutine checkpoint_write ( )
+
+!*****************************************************************************80
+!
+!! CHECKPOINT_WRITE queues the state after STEP for writing.
+!
+    integer ( kind = 8 ) header(8)
+
+    header(1) = transfer ( 'MDCHECKP', 0_8 )
+    header(2) = np
+    header(3) = size ( pos, 1 )
+    header(4) = step
+    header(5) = merge ( 1, 0, soa )
+    header(6) = nbr_build_num
+    header(7:8) = 0
+
+    call async_io_begin ( checkpoint_io, &
+      trim ( checkpoint_file ) // c_null_char )
+    call async_io_append ( checkpoint_io, header, 8_c_size_t * 8 )
+    call async_io_append ( checkpoint_io, [ e0 ], 8_c_size_t )
+    call async_io_append ( checkpoint_io, pos, 8_c_size_t * size ( pos ) )
+    call async_io_append ( checkpoint_io, vel, 8_c_size_t * size ( vel ) )
+    call async_io_append ( checkpoint_io, acc, 8_c_size_t * size ( acc ) )
+    call async_io_append ( checkpoint_io, pos_ref, &
+      8_c_size_t * size ( pos_ref ) )
+    call async_io_commit ( checkpoint_io )
+
+    return
+  end subroutine checkpoint_write
+  subroutine neighbor_rebuild ( p )
+
+!*****************************************************************************80
+!
+!! NEIGHBOR_REBUILD builds the neighbor list for the positions P.
+!
+!  Discussion:
+!
+!    If the list array is too small, it is enlarged and the build repeated.
+!
+    real ( kind = 8 ) p(nd,np)
+
+    do
+      call neighbor_build ( np, nd, p, PI2 + skin, half, nbr_max, &
+        nbr_first, nbr_list, nbr_num )
+      if ( nbr_num <= nbr_max ) then
+        exit
+      end if
+      nbr_max = nbr_num + nbr_num / 4
+      deallocate ( nbr_list )
+      allocate ( nbr_list(nbr_max) )
+    end do
+
+    return
+  end subroutine neighbor_rebuild
 end
 subroutine compute ( np, nd, pos, vel, mass, f, pot, kin )
 
@@ -198,6 +823,8 @@ subroutine compute ( np, nd, pos, vel, mass, f, pot, kin )
 !
 !    Output, real ( kind = 8 ) KIN, the total kinetic energy.
 !
+  use omp_regions
+
   implicit none
 
   integer ( kind = 4 ) np
@@ -219,11 +846,14 @@ subroutine compute ( np, nd, pos, vel, mass, f, pot, kin )
   pot = 0.0D+00
   kin = 0.0D+00
 
+  call region_fork ( 'compute' // c_null_char )
 !$omp parallel &
 !$omp shared ( f, nd, np, pos, vel ) &
 !$omp private ( d, d2, i, j, rij )
 
-!$omp do reduction ( + : pot, kin )
+  call region_start ( )
+
+!$omp do schedule ( static ) reduction ( + : pot, kin )
 
   do i = 1, np
 !
@@ -254,77 +884,200 @@ subroutine compute ( np, nd, pos, vel, mass, f, pot, kin )
     kin = kin + sum ( vel(1:nd,i)**2 )
 
   end do
-!$omp end do
+!$omp end do nowait
+  call region_work ( 'compute' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute' // c_null_char )
 
 !$omp end parallel
+  call region_join ( )
 
   kin = kin * 0.5D+00 * mass
   
   return
 end
-subroutine dist ( nd, r1, r2, dr, d )
+subroutine compute_half ( np, nd, pos, vel, mass, thread_num, f_thread, &
+  f, pot, kin )
 
 !*****************************************************************************80
 !
-!! DIST computes the displacement and distance between two particles.
+!! COMPUTE_HALF computes the forces and energies, visiting each pair once.
 !
-!  Licensing:
+!  Discussion:
 !
-!    This code is distributed under the GNU LGPL license. 
+!    This computes the same quantities as COMPUTE, but evaluates each pair
+!    (I,J) with I < J only once, adding the force to particle I and
+!    subtracting it from particle J.
 !
-!  Modified:
+!    Since two threads may update the force on the same particle, each
+!    thread accumulates into its own slice of F_THREAD, and the slices
+!    are summed into F afterwards.  The rows of the triangle get shorter
+!    as I increases, so row K is paired with row NP+1-K, and the pairs,
+!    all of the same length, are divided statically among the threads.
+!    Each thread then always handles the same rows, and the forces are
+!    summed in the same order on every run.  For the same reason, the
+!    energies are summed per thread and then in thread order, rather than
+!    by a REDUCTION clause, whose combining order is unspecified.
 !
-!    17 March 2002
+!  Parameters:
 !
-!  Author:
+!    Input, integer ( kind = 4 ) NP, the number of particles.
 !
-!    Original FORTRAN90 version by Bill Magro.
-!    This FORTRAN90 version by John Burkardt.
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
 !
-!  Parameters:
+!    Input, real ( kind = 8 ) POS(ND,NP), the position of each particle.
 !
-!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!    Input, real ( kind = 8 ) VEL(ND,NP), the velocity of each particle.
 !
-!    Input, real ( kind = 8 ) R1(ND), R2(ND), the positions of the particles.
+!    Input, real ( kind = 8 ) MASS, the mass of each particle.
 !
-!    Output, real ( kind = 8 ) DR(ND), the displacement vector.
+!    Input, integer ( kind = 4 ) THREAD_NUM, the maximum number of threads.
 !
-!    Output, real ( kind = 8 ) D, the Euclidean norm of the displacement,
-!    in other words, the distance between the two particles.
+!    Workspace, real ( kind = 8 ) F_THREAD(ND,NP,0:THREAD_NUM-1).
+!
+!    Output, real ( kind = 8 ) F(ND,NP), the forces.
+!
+!    Output, real ( kind = 8 ) POT, the total potential energy.
+!
+!    Output, real ( kind = 8 ) KIN, the total kinetic energy.
 !
+  use omp_lib
+  use omp_regions
+
   implicit none
 
+  integer ( kind = 4 ) np
   integer ( kind = 4 ) nd
+  integer ( kind = 4 ) thread_num
 
   real ( kind = 8 ) d
-  real ( kind = 8 ) dr(nd)
-  real ( kind = 8 ) r1(nd)
-  real ( kind = 8 ) r2(nd)
+  real ( kind = 8 ) d2
+  real ( kind = 8 ) e_thread(2,0:thread_num-1)
+  real ( kind = 8 ) f(nd,np)
+  real ( kind = 8 ) f_thread(nd,np,0:thread_num-1)
+  real ( kind = 8 ) fij(nd)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) id
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) k
+  real ( kind = 8 ) kin
+  real ( kind = 8 ) kin_id
+  integer ( kind = 4 ) l
+  real ( kind = 8 ) mass
+  integer ( kind = 4 ) nt
+  real ( kind = 8 ), parameter :: PI2 = 3.141592653589793D+00 / 2.0D+00
+  real ( kind = 8 ) pos(nd,np)
+  real ( kind = 8 ) pot
+  real ( kind = 8 ) pot_id
+  real ( kind = 8 ) rij(nd)
+  real ( kind = 8 ) vel(nd,np)
 
-  dr(1:nd) = r1(1:nd) - r2(1:nd)
+  e_thread(1:2,0:thread_num-1) = 0.0D+00
 
-  d = sqrt ( sum ( dr(1:nd)**2 ) )
+  call region_fork ( 'compute_half' // c_null_char )
+!$omp parallel &
+!$omp shared ( e_thread, f, f_thread, nd, np, pos, vel ) &
+!$omp private ( d, d2, fij, i, id, j, k, kin_id, l, nt, pot_id, rij )
 
-  return
-end
-subroutine initialize ( np, nd, box, seed, pos, vel, acc )
+  call region_start ( )
 
-!*****************************************************************************80
+  id = omp_get_thread_num ( )
+  nt = omp_get_num_threads ( )
+
+  f_thread(1:nd,1:np,id) = 0.0D+00
+  pot_id = 0.0D+00
+  kin_id = 0.0D+00
+
+  call region_work ( 'compute_half zero' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_half zero' // c_null_char )
+
+!$omp do schedule ( static )
+
+  do k = 1, ( np + 1 ) / 2
+
+    do l = 1, 2
+
+      if ( l == 1 ) then
+        i = k
+      else
+        i = np + 1 - k
+        if ( i == k ) then
+          exit
+        end if
+      end if
+
+      do j = i + 1, np
+
+        call dist ( nd, pos(1,i), pos(1,j), rij, d )
 !
-!! INITIALIZE initializes the positions, velocities, and accelerations.
+!  The pair carries the potential energy of both of its particles.
 !
-!  Licensing:
+        d2 = min ( d, PI2 )
+
+        pot_id = pot_id + ( sin ( d2 ) )**2
+
+        fij(1:nd) = rij(1:nd) * sin ( 2.0D+00 * d2 ) / d
+
+        f_thread(1:nd,i,id) = f_thread(1:nd,i,id) - fij(1:nd)
+        f_thread(1:nd,j,id) = f_thread(1:nd,j,id) + fij(1:nd)
+
+      end do
+
+      kin_id = kin_id + sum ( vel(1:nd,i)**2 )
+
+    end do
+
+  end do
+!$omp end do nowait
+  e_thread(1,id) = pot_id
+  e_thread(2,id) = kin_id
+  call region_work ( 'compute_half pairs' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_half pairs' // c_null_char )
 !
-!    This code is distributed under the GNU LGPL license. 
+!  Sum the thread copies.
 !
-!  Modified:
+!$omp do schedule ( static )
+  do i = 1, np
+    f(1:nd,i) = sum ( f_thread(1:nd,i,0:nt-1), dim = 2 )
+  end do
+!$omp end do nowait
+  call region_work ( 'compute_half sum' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_half sum' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  pot = 0.0D+00
+  kin = 0.0D+00
+  do id = 0, thread_num - 1
+    pot = pot + e_thread(1,id)
+    kin = kin + e_thread(2,id)
+  end do
+
+  kin = kin * 0.5D+00 * mass
+
+  return
+end
+subroutine compute_neighbor ( np, nd, pos, vel, mass, nbr_first, nbr_list, &
+  f, pot, kin )
+
+!*****************************************************************************80
 !
-!    21 November 2007
+!! COMPUTE_NEIGHBOR computes the forces and energies from a neighbor list.
 !
-!  Author:
+!  Discussion:
 !
-!    Original FORTRAN90 version by Bill Magro.
-!    This FORTRAN90 version by John Burkardt.
+!    This computes the same quantities as COMPUTE, but only visits the
+!    pairs recorded in the neighbor list.
+!
+!    A pair at distance PI2 or more contributes the constant 0.5*sin(PI2)^2
+!    to the potential energy of each of its two particles, and a force of
+!    sin(PI) = 1.2E-16 that COMPUTE keeps and this routine neglects.  Pairs
+!    missing from the list are therefore accounted for by counting the
+!    pairs inside PI2 and adding the constant for all of the others.
 !
 !  Parameters:
 !
@@ -332,64 +1085,1239 @@ subroutine initialize ( np, nd, box, seed, pos, vel, acc )
 !
 !    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
 !
-!    Input, real ( kind = 8 ) BOX(ND), specifies the maximum position
-!    of particles in each dimension.
+!    Input, real ( kind = 8 ) POS(ND,NP), the position of each particle.
 !
-!    Input/output, integer ( kind = 4 ) SEED, a seed for the random 
-!    number generator.
+!    Input, real ( kind = 8 ) VEL(ND,NP), the velocity of each particle.
 !
-!    Output, real ( kind = 8 ) POS(ND,NP), the position of each particle.
+!    Input, real ( kind = 8 ) MASS, the mass of each particle.
 !
-!    Output, real ( kind = 8 ) VEL(ND,NP), the velocity of each particle.
+!    Input, integer ( kind = 4 ) NBR_FIRST(NP+1), NBR_LIST(*), the neighbors
+!    of particle I are NBR_LIST(NBR_FIRST(I):NBR_FIRST(I+1)-1).
 !
-!    Output, real ( kind = 8 ) ACC(ND,NP), the acceleration of each particle.
+!    Output, real ( kind = 8 ) F(ND,NP), the forces.
+!
+!    Output, real ( kind = 8 ) POT, the total potential energy.
+!
+!    Output, real ( kind = 8 ) KIN, the total kinetic energy.
 !
+  use omp_regions
+
   implicit none
 
   integer ( kind = 4 ) np
   integer ( kind = 4 ) nd
 
-  real ( kind = 8 ) acc(nd,np)
-  real ( kind = 8 ) box(nd)
-  integer ( kind = 4 ) j
-  integer ( kind = 4 ) seed
+  real ( kind = 8 ) d
+  real ( kind = 8 ) f(nd,np)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) k
+  real ( kind = 8 ) kin
+  real ( kind = 8 ) mass
+  integer ( kind = 4 ) nbr_first(np+1)
+  integer ( kind = 4 ) nbr_list(*)
+  integer ( kind = 8 ) near
+  real ( kind = 8 ), parameter :: PI2 = 3.141592653589793D+00 / 2.0D+00
+  real ( kind = 8 ) pos(nd,np)
+  real ( kind = 8 ) pot
+  real ( kind = 8 ) rij(nd)
+  real ( kind = 8 ) vel(nd,np)
+
+  pot = 0.0D+00
+  kin = 0.0D+00
+  near = 0
+
+  call region_fork ( 'compute_neighbor' // c_null_char )
+!$omp parallel &
+!$omp shared ( f, nbr_first, nbr_list, nd, np, pos, vel ) &
+!$omp private ( d, i, j, k, rij )
+
+  call region_start ( )
+
+!$omp do schedule ( static ) reduction ( + : pot, kin, near )
+
+  do i = 1, np
+
+    f(1:nd,i) = 0.0D+00
+
+    do k = nbr_first(i), nbr_first(i+1) - 1
+
+      j = nbr_list(k)
+
+      call dist ( nd, pos(1,i), pos(1,j), rij, d )
+
+      if ( d < PI2 ) then
+
+        pot = pot + 0.5D+00 * ( sin ( d ) )**2
+
+        f(1:nd,i) = f(1:nd,i) - rij(1:nd) * sin ( 2.0D+00 * d ) / d
+
+        near = near + 1
+
+      end if
+
+    end do
+
+    kin = kin + sum ( vel(1:nd,i)**2 )
+
+  end do
+!$omp end do nowait
+  call region_work ( 'compute_neighbor' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_neighbor' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+!
+!  Add the saturated potential of the pairs beyond PI2.
+!
+  pot = pot + 0.5D+00 * ( sin ( PI2 ) )**2 &
+    * ( real ( np, kind = 8 ) * real ( np - 1, kind = 8 ) &
+    - real ( near, kind = 8 ) )
+
+  kin = kin * 0.5D+00 * mass
+
+  return
+end
+subroutine compute_neighbor_half ( np, nd, pos, vel, mass, nbr_first, &
+  nbr_list, thread_num, f_thread, f, pot, kin )
+
+!*****************************************************************************80
+!
+!! COMPUTE_NEIGHBOR_HALF computes forces and energies from a half neighbor list.
+!
+!  Discussion:
+!
+!    This is COMPUTE_NEIGHBOR for a list built with HALF = TRUE, in which
+!    each pair appears once.  As in COMPUTE_HALF, the force is applied to
+!    both particles of the pair, and each thread accumulates into its own
+!    slice of F_THREAD.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP, the number of particles.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) POS(ND,NP), the position of each particle.
+!
+!    Input, real ( kind = 8 ) VEL(ND,NP), the velocity of each particle.
+!
+!    Input, real ( kind = 8 ) MASS, the mass of each particle.
+!
+!    Input, integer ( kind = 4 ) NBR_FIRST(NP+1), NBR_LIST(*), the neighbors
+!    J > I of particle I are NBR_LIST(NBR_FIRST(I):NBR_FIRST(I+1)-1).
+!
+!    Input, integer ( kind = 4 ) THREAD_NUM, the maximum number of threads.
+!
+!    Workspace, real ( kind = 8 ) F_THREAD(ND,NP,0:THREAD_NUM-1).
+!
+!    Output, real ( kind = 8 ) F(ND,NP), the forces.
+!
+!    Output, real ( kind = 8 ) POT, the total potential energy.
+!
+!    Output, real ( kind = 8 ) KIN, the total kinetic energy.
+!
+  use omp_lib
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) np
+  integer ( kind = 4 ) nd
+  integer ( kind = 4 ) thread_num
+
+  real ( kind = 8 ) d
+  real ( kind = 8 ) f(nd,np)
+  real ( kind = 8 ) f_thread(nd,np,0:thread_num-1)
+  real ( kind = 8 ) fij(nd)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) id
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) k
+  real ( kind = 8 ) kin
+  real ( kind = 8 ) mass
+  integer ( kind = 4 ) nbr_first(np+1)
+  integer ( kind = 4 ) nbr_list(*)
+  integer ( kind = 8 ) near
+  integer ( kind = 4 ) nt
+  real ( kind = 8 ), parameter :: PI2 = 3.141592653589793D+00 / 2.0D+00
+  real ( kind = 8 ) pos(nd,np)
+  real ( kind = 8 ) pot
+  real ( kind = 8 ) rij(nd)
+  real ( kind = 8 ) vel(nd,np)
+
+  pot = 0.0D+00
+  kin = 0.0D+00
+  near = 0
+
+  call region_fork ( 'compute_neighbor_half' // c_null_char )
+!$omp parallel &
+!$omp shared ( f, f_thread, nbr_first, nbr_list, nd, np, pos, vel ) &
+!$omp private ( d, fij, i, id, j, k, nt, rij )
+
+  call region_start ( )
+
+  id = omp_get_thread_num ( )
+  nt = omp_get_num_threads ( )
+
+  f_thread(1:nd,1:np,id) = 0.0D+00
+
+  call region_work ( 'compute_neighbor_half zero' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_neighbor_half zero' // c_null_char )
+
+!$omp do schedule ( static ) reduction ( + : pot, kin, near )
+
+  do i = 1, np
+
+    do k = nbr_first(i), nbr_first(i+1) - 1
+
+      j = nbr_list(k)
+
+      call dist ( nd, pos(1,i), pos(1,j), rij, d )
+
+      if ( d < PI2 ) then
+
+        pot = pot + ( sin ( d ) )**2
+
+        fij(1:nd) = rij(1:nd) * sin ( 2.0D+00 * d ) / d
+
+        f_thread(1:nd,i,id) = f_thread(1:nd,i,id) - fij(1:nd)
+        f_thread(1:nd,j,id) = f_thread(1:nd,j,id) + fij(1:nd)
+
+        near = near + 1
+
+      end if
+
+    end do
+
+    kin = kin + sum ( vel(1:nd,i)**2 )
+
+  end do
+!$omp end do nowait
+  call region_work ( 'compute_neighbor_half pairs' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_neighbor_half pairs' // c_null_char )
+
+!$omp do schedule ( static )
+  do i = 1, np
+    f(1:nd,i) = sum ( f_thread(1:nd,i,0:nt-1), dim = 2 )
+  end do
+!$omp end do nowait
+  call region_work ( 'compute_neighbor_half sum' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_neighbor_half sum' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+!
+!  Add the saturated potential of the pairs beyond PI2.  NEAR counts
+!  each pair once.
+!
+  pot = pot + 0.5D+00 * ( sin ( PI2 ) )**2 &
+    * ( real ( np, kind = 8 ) * real ( np - 1, kind = 8 ) &
+    - 2.0D+00 * real ( near, kind = 8 ) )
+
+  kin = kin * 0.5D+00 * mass
+
+  return
+end
+subroutine compute_soa ( np, np_pad, nd, pos, vel, mass, f, pot, kin )
+
+!*****************************************************************************80
+!
+!! COMPUTE_SOA computes the forces and energies for the SOA layout.
+!
+!  Discussion:
+!
+!    This is COMPUTE for particles stored as structure of arrays: column
+!    K of POS holds coordinate K of every particle.  The inner loop over
+!    J then reads consecutive elements of each column, and is vectorized
+!    across J with OMP SIMD.  The pair I = J is masked off rather than
+!    skipped, so that the loop has no branch.
+!
+!    The library SIN is not vectorized, so the sine and cosine come from
+!    polynomials.  With T = 2 * min ( D, PI2 ) in [0,PI] and U = T - PI/2
+!    in [-PI/2,PI/2],
+!
+!      sin ( T ) = cos ( U ),  sin ( T / 2 )^2 = ( 1 + sin ( U ) ) / 2,
+!
+!    and sin ( U ) and cos ( U ) are their Taylor series through U^17 and
+!    U^18, whose error on this interval is below 1.0D-13.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP, the number of particles.
+!
+!    Input, integer ( kind = 4 ) NP_PAD, the leading dimension of the
+!    arrays, NP rounded up to a multiple of 8.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) POS(NP_PAD,ND), the position of each particle.
+!
+!    Input, real ( kind = 8 ) VEL(NP_PAD,ND), the velocity of each particle.
+!
+!    Input, real ( kind = 8 ) MASS, the mass of each particle.
+!
+!    Output, real ( kind = 8 ) F(NP_PAD,ND), the forces.
+!
+!    Output, real ( kind = 8 ) POT, the total potential energy.
+!
+!    Output, real ( kind = 8 ) KIN, the total kinetic energy.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) nd
+  integer ( kind = 4 ) np_pad
+
+  real ( kind = 8 ), parameter :: c02 = -1.0D+00 / 2.0D+00
+  real ( kind = 8 ), parameter :: c04 = 1.0D+00 / 24.0D+00
+  real ( kind = 8 ), parameter :: c06 = -1.0D+00 / 720.0D+00
+  real ( kind = 8 ), parameter :: c08 = 1.0D+00 / 40320.0D+00
+  real ( kind = 8 ), parameter :: c10 = -1.0D+00 / 3628800.0D+00
+  real ( kind = 8 ), parameter :: c12 = 1.0D+00 / 479001600.0D+00
+  real ( kind = 8 ), parameter :: c14 = -1.0D+00 / 87178291200.0D+00
+  real ( kind = 8 ), parameter :: c16 = 1.0D+00 / 20922789888000.0D+00
+  real ( kind = 8 ), parameter :: c18 = -1.0D+00 / 6402373705728000.0D+00
+  real ( kind = 8 ) cs
+  real ( kind = 8 ) d
+  real ( kind = 8 ) dinv
+  real ( kind = 8 ) f(np_pad,nd)
+  real ( kind = 8 ) fx
+  real ( kind = 8 ) fy
+  real ( kind = 8 ) fz
+  real ( kind = 8 ) g
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  real ( kind = 8 ) kin
+  real ( kind = 8 ) mass
+  integer ( kind = 4 ) np
+  real ( kind = 8 ), parameter :: PI2 = 3.141592653589793D+00 / 2.0D+00
+  real ( kind = 8 ) pos(np_pad,nd)
+  real ( kind = 8 ) pot
+  real ( kind = 8 ) pot_i
+  real ( kind = 8 ) rx
+  real ( kind = 8 ) ry
+  real ( kind = 8 ) rz
+  real ( kind = 8 ), parameter :: s03 = -1.0D+00 / 6.0D+00
+  real ( kind = 8 ), parameter :: s05 = 1.0D+00 / 120.0D+00
+  real ( kind = 8 ), parameter :: s07 = -1.0D+00 / 5040.0D+00
+  real ( kind = 8 ), parameter :: s09 = 1.0D+00 / 362880.0D+00
+  real ( kind = 8 ), parameter :: s11 = -1.0D+00 / 39916800.0D+00
+  real ( kind = 8 ), parameter :: s13 = 1.0D+00 / 6227020800.0D+00
+  real ( kind = 8 ), parameter :: s15 = -1.0D+00 / 1307674368000.0D+00
+  real ( kind = 8 ), parameter :: s17 = 1.0D+00 / 355687428096000.0D+00
+  real ( kind = 8 ) sn
+  real ( kind = 8 ) u
+  real ( kind = 8 ) u2
+  real ( kind = 8 ) vel(np_pad,nd)
+  real ( kind = 8 ) xi
+  real ( kind = 8 ) yi
+  real ( kind = 8 ) zi
+
+  pot = 0.0D+00
+  kin = 0.0D+00
+
+  call region_fork ( 'compute_soa' // c_null_char )
+!$omp parallel &
+!$omp shared ( f, np, pos, vel ) &
+!$omp private ( cs, d, dinv, fx, fy, fz, g, i, j, pot_i, rx, ry, rz, sn, &
+!$omp   u, u2, xi, yi, zi )
+
+  call region_start ( )
+
+!$omp do schedule ( static ) reduction ( + : pot, kin )
+
+  do i = 1, np
+
+    xi = pos(i,1)
+    yi = pos(i,2)
+    zi = pos(i,3)
+    fx = 0.0D+00
+    fy = 0.0D+00
+    fz = 0.0D+00
+    pot_i = 0.0D+00
+
+!$omp simd reduction ( + : fx, fy, fz, pot_i )
+    do j = 1, np
+
+      rx = xi - pos(j,1)
+      ry = yi - pos(j,2)
+      rz = zi - pos(j,3)
+      d = sqrt ( rx * rx + ry * ry + rz * rz )
+!
+!  DINV is 0 for the pair I = J, which then adds nothing.
+!
+      dinv = merge ( 0.0D+00, 1.0D+00 / max ( d, 1.0D-30 ), i == j )
+
+      u = 2.0D+00 * min ( d, PI2 ) - PI2
+      u2 = u * u
+      sn = u * ( 1.0D+00 + u2 * ( s03 + u2 * ( s05 + u2 * ( s07 + u2 * ( &
+        s09 + u2 * ( s11 + u2 * ( s13 + u2 * ( s15 + u2 * s17 ) ) ) ) ) ) ) )
+      cs = 1.0D+00 + u2 * ( c02 + u2 * ( c04 + u2 * ( c06 + u2 * ( c08 + &
+        u2 * ( c10 + u2 * ( c12 + u2 * ( c14 + u2 * ( c16 + u2 * c18 ) ) ) &
+        ) ) ) ) )
+!
+!  Attribute half of the potential energy, ( 1 + SN ) / 4, to particle J.
+!
+      pot_i = pot_i + merge ( 0.0D+00, 0.25D+00 * ( 1.0D+00 + sn ), i == j )
+
+      g = cs * dinv
+      fx = fx - rx * g
+      fy = fy - ry * g
+      fz = fz - rz * g
+
+    end do
+
+    f(i,1) = fx
+    f(i,2) = fy
+    f(i,3) = fz
+    pot = pot + pot_i
+    kin = kin + vel(i,1)**2 + vel(i,2)**2 + vel(i,3)**2
+
+  end do
+!$omp end do nowait
+  call region_work ( 'compute_soa' // c_null_char )
+!$omp barrier
+  call region_wait ( 'compute_soa' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  kin = kin * 0.5D+00 * mass
+
+  return
+end
+subroutine dist ( nd, r1, r2, dr, d )
+
+!*****************************************************************************80
+!
+!! DIST computes the displacement and distance between two particles.
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license. 
+!
+!  Modified:
+!
+!    17 March 2002
+!
+!  Author:
+!
+!    Original FORTRAN90 version by Bill Magro.
+!    This FORTRAN90 version by John Burkardt.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) R1(ND), R2(ND), the positions of the particles.
+!
+!    Output, real ( kind = 8 ) DR(ND), the displacement vector.
+!
+!    Output, real ( kind = 8 ) D, the Euclidean norm of the displacement,
+!    in other words, the distance between the two particles.
+!
+  implicit none
+
+  integer ( kind = 4 ) nd
+
+  real ( kind = 8 ) d
+  real ( kind = 8 ) dr(nd)
+  real ( kind = 8 ) r1(nd)
+  real ( kind = 8 ) r2(nd)
+
+  dr(1:nd) = r1(1:nd) - r2(1:nd)
+
+  d = sqrt ( sum ( dr(1:nd)**2 ) )
+
+  return
+end
+function i4_lcg_skip ( seed, k )
+
+!*****************************************************************************80
+!
+!! I4_LCG_SKIP advances the seed of R8_UNIFORM_01 by K steps.
+!
+!  Discussion:
+!
+!    R8_UNIFORM_01 replaces SEED by mod ( 16807 * SEED, 2**31 - 1 ), so
+!    K steps multiply SEED by 16807**K, computed here by repeated squaring.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) SEED, the seed.
+!
+!    Input, integer ( kind = 4 ) K, the number of steps, at least 0.
+!
+!    Output, integer ( kind = 4 ) I4_LCG_SKIP, the seed after K steps.
+!
+  implicit none
+
+  integer ( kind = 8 ) a
+  integer ( kind = 4 ) i4_lcg_skip
+  integer ( kind = 4 ) k
+  integer ( kind = 8 ) m
+  integer ( kind = 8 ) r
+  integer ( kind = 4 ) seed
+  integer ( kind = 4 ) steps
+
+  m = 2147483647_8
+  a = 16807_8
+  r = modulo ( int ( seed, kind = 8 ), m )
+  steps = k
+
+  do while ( 0 < steps )
+    if ( mod ( steps, 2 ) == 1 ) then
+      r = mod ( r * a, m )
+    end if
+    a = mod ( a * a, m )
+    steps = steps / 2
+  end do
+
+  i4_lcg_skip = int ( r, kind = 4 )
+
+  return
+end
+subroutine initialize ( np, nd, box, seed, pos, vel, acc )
+
+!*****************************************************************************80
+!
+!! INITIALIZE initializes the positions, velocities, and accelerations.
+!
+!  Discussion:
+!
+!    Each array is first written by the threads that later update it,
+!    using the same static partition over particles as UPDATE, so that
+!    on a NUMA system its pages are placed on the nodes of those threads.
+!
+!    The positions come from the linear congruential generator of
+!    R8_UNIFORM_01, particle J taking values (J-1)*ND+1 through J*ND of
+!    the sequence.  Each thread jumps ahead in the sequence to its first
+!    particle, so the positions do not depend on the number of threads.
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license. 
+!
+!  Modified:
+!
+!    21 November 2007
+!
+!  Author:
+!
+!    Original FORTRAN90 version by Bill Magro.
+!    This FORTRAN90 version by John Burkardt.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP, the number of particles.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) BOX(ND), specifies the maximum position
+!    of particles in each dimension.
+!
+!    Input/output, integer ( kind = 4 ) SEED, a seed for the random 
+!    number generator.  On output, the seed after NP*ND values.
+!
+!    Output, real ( kind = 8 ) POS(ND,NP), the position of each particle.
+!
+!    Output, real ( kind = 8 ) VEL(ND,NP), the velocity of each particle.
+!
+!    Output, real ( kind = 8 ) ACC(ND,NP), the acceleration of each particle.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) np
+  integer ( kind = 4 ) nd
+
+  real ( kind = 8 ) acc(nd,np)
+  real ( kind = 8 ) box(nd)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) i4_lcg_skip
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) j_next
+  integer ( kind = 4 ) seed
+  integer ( kind = 4 ) seed_j
+  real ( kind = 8 ) pos(nd,np)
+  real ( kind = 8 ) r8_uniform_01
+  real ( kind = 8 ) vel(nd,np)
+!
+!  Pick random locations inside the box.  Velocities and accelerations
+!  begin at 0.
+!
+  j_next = 0
+  seed_j = seed
+
+  call region_fork ( 'initialize' // c_null_char )
+!$omp parallel &
+!$omp shared ( acc, box, nd, np, pos, seed, vel ) &
+!$omp firstprivate ( j_next, seed_j ) &
+!$omp private ( i, j )
+
+  call region_start ( )
+
+!$omp do schedule ( static )
+
+  do j = 1, np
+    if ( j /= j_next ) then
+      seed_j = i4_lcg_skip ( seed, ( j - 1 ) * nd )
+    end if
+    do i = 1, nd
+      pos(i,j) = box(i) * r8_uniform_01 ( seed_j )
+    end do
+    vel(1:nd,j) = 0.0D+00
+    acc(1:nd,j) = 0.0D+00
+    j_next = j + 1
+  end do
+
+!$omp end do nowait
+  call region_work ( 'initialize' // c_null_char )
+!$omp barrier
+  call region_wait ( 'initialize' // c_null_char )
+!$omp end parallel
+  call region_join ( )
+
+  seed = i4_lcg_skip ( seed, np * nd )
+
+  return
+end
+subroutine initialize_soa ( np, np_pad, nd, box, seed, pos, vel, acc, f )
+
+!*****************************************************************************80
+!
+!! INITIALIZE_SOA initializes the particles for the SOA layout.
+!
+!  Discussion:
+!
+!    This is INITIALIZE for arrays whose column K holds coordinate K of
+!    every particle.  The positions are the same as those of INITIALIZE.
+!    The forces, and the padding rows NP+1 to NP_PAD, are zeroed here
+!    too, so that every array is first touched by the static partition
+!    of the particles that later computes on it.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP, the number of particles.
+!
+!    Input, integer ( kind = 4 ) NP_PAD, the leading dimension of the
+!    arrays.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) BOX(ND), specifies the maximum position
+!    of particles in each dimension.
+!
+!    Input/output, integer ( kind = 4 ) SEED, a seed for the random number
+!    generator.
+!
+!    Output, real ( kind = 8 ) POS(NP_PAD,ND), the position of each particle.
+!
+!    Output, real ( kind = 8 ) VEL(NP_PAD,ND), the velocity of each particle.
+!
+!    Output, real ( kind = 8 ) ACC(NP_PAD,ND), the acceleration of each
+!    particle.
+!
+!    Output, real ( kind = 8 ) F(NP_PAD,ND), the force on each particle.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) nd
+  integer ( kind = 4 ) np_pad
+
+  real ( kind = 8 ) acc(np_pad,nd)
+  real ( kind = 8 ) box(nd)
+  real ( kind = 8 ) f(np_pad,nd)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) i4_lcg_skip
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) j_next
+  integer ( kind = 4 ) np
+  real ( kind = 8 ) pos(np_pad,nd)
+  real ( kind = 8 ) r8_uniform_01
+  integer ( kind = 4 ) seed
+  integer ( kind = 4 ) seed_j
+  real ( kind = 8 ) vel(np_pad,nd)
+
+  j_next = 0
+  seed_j = seed
+
+  call region_fork ( 'initialize_soa' // c_null_char )
+!$omp parallel &
+!$omp shared ( acc, box, f, nd, np, np_pad, pos, seed, vel ) &
+!$omp firstprivate ( j_next, seed_j ) &
+!$omp private ( i, j )
+
+  call region_start ( )
+
+!$omp do schedule ( static )
+
+  do j = 1, np_pad
+    if ( j <= np ) then
+      if ( j /= j_next ) then
+        seed_j = i4_lcg_skip ( seed, ( j - 1 ) * nd )
+      end if
+      do i = 1, nd
+        pos(j,i) = box(i) * r8_uniform_01 ( seed_j )
+      end do
+      j_next = j + 1
+    else
+      pos(j,1:nd) = 0.0D+00
+    end if
+    vel(j,1:nd) = 0.0D+00
+    acc(j,1:nd) = 0.0D+00
+    f(j,1:nd) = 0.0D+00
+  end do
+
+!$omp end do nowait
+  call region_work ( 'initialize_soa' // c_null_char )
+!$omp barrier
+  call region_wait ( 'initialize_soa' // c_null_char )
+!$omp end parallel
+  call region_join ( )
+
+  seed = i4_lcg_skip ( seed, np * nd )
+
+  return
+end
+subroutine neighbor_build ( np, nd, pos, rlist, half, nbr_max, nbr_first, &
+  nbr_list, nbr_num )
+
+!*****************************************************************************80
+!
+!! NEIGHBOR_BUILD builds a Verlet neighbor list using linked cells.
+!
+!  Discussion:
+!
+!    The bounding box of the particles is divided into cells whose sides
+!    are at least RLIST long, and each particle is threaded onto the linked
+!    list of its cell.  The neighbors of a particle can then only be in its
+!    own cell or the 26 cells around it, so the build costs O(NP).
+!
+!    The list is built in two parallel passes: the first counts the
+!    neighbors of each particle, so that NBR_FIRST can be set, and the
+!    second stores them.  If NBR_MAX is too small to hold the list, the
+!    routine returns after the first pass with NBR_NUM > NBR_MAX, and the
+!    caller should enlarge NBR_LIST and call again.
+!
+!    If HALF is TRUE, only the neighbors J > I of particle I are stored, so
+!    that each pair appears once.
+!
+!    The code assumes ND = 3.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP, the number of particles.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) POS(ND,NP), the position of each particle.
+!
+!    Input, real ( kind = 8 ) RLIST, the list cutoff distance.
+!
+!    Input, logical HALF, is TRUE if each pair is to be stored only once.
+!
+!    Input, integer ( kind = 4 ) NBR_MAX, the size of NBR_LIST.
+!
+!    Output, integer ( kind = 4 ) NBR_FIRST(NP+1), NBR_LIST(NBR_MAX), the
+!    neighbors of particle I are NBR_LIST(NBR_FIRST(I):NBR_FIRST(I+1)-1).
+!
+!    Output, integer ( kind = 4 ) NBR_NUM, the number of list entries.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) nbr_max
+  integer ( kind = 4 ) np
+  integer ( kind = 4 ) nd
+
+  integer ( kind = 4 ) c(3)
+  integer ( kind = 4 ), allocatable :: cell_head(:)
+  integer ( kind = 4 ), allocatable :: cell_next(:)
+  real ( kind = 8 ) cell_width(3)
+  integer ( kind = 4 ) cx
+  integer ( kind = 4 ) cy
+  integer ( kind = 4 ) cz
+  logical half
+  real ( kind = 8 ) hi(3)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  integer ( kind = 4 ) k
+  real ( kind = 8 ) lo(3)
+  integer ( kind = 4 ) nbr_first(np+1)
+  integer ( kind = 4 ) nbr_list(nbr_max)
+  integer ( kind = 4 ) nbr_num
+  integer ( kind = 4 ) nc(3)
+  integer ( kind = 4 ) nc_max
+  integer ( kind = 4 ) pass
   real ( kind = 8 ) pos(nd,np)
-  real ( kind = 8 ) r8_uniform_01
-  real ( kind = 8 ) vel(nd,np)
+  real ( kind = 8 ) rlist
+  real ( kind = 8 ) rlist2
 !
-!  Start by setting the positions to random numbers between 0 and 1.
+!  Choose the cells.  Particles are not confined to the box, so use their
+!  bounding box, and limit the number of cells if they have spread far.
 !
-  call random_number ( harvest = pos(1:nd,1:np) )
+  nc_max = max ( 1, &
+    nint ( 2.0D+00 * real ( np, kind = 8 )**( 1.0D+00 / 3.0D+00 ) ) )
+
+  do k = 1, 3
+    lo(k) = minval ( pos(k,1:np) )
+    hi(k) = maxval ( pos(k,1:np) )
+    nc(k) = max ( 1, min ( nc_max, int ( ( hi(k) - lo(k) ) / rlist ) ) )
+    cell_width(k) = &
+      max ( ( hi(k) - lo(k) ) / real ( nc(k), kind = 8 ), rlist )
+  end do
+
+  allocate ( cell_head(0:nc(1)*nc(2)*nc(3)-1) )
+  allocate ( cell_next(np) )
 !
-!  Use these random values as scale factors to pick random locations
-!  inside the box.
+!  Thread the particles onto the cells in decreasing order, so that each
+!  cell lists its particles in increasing order.
 !
+  cell_head(:) = 0
+
+  do i = np, 1, -1
+    do k = 1, 3
+      c(k) = min ( nc(k) - 1, int ( ( pos(k,i) - lo(k) ) / cell_width(k) ) )
+    end do
+    j = c(1) + nc(1) * ( c(2) + nc(2) * c(3) )
+    cell_next(i) = cell_head(j)
+    cell_head(j) = i
+  end do
+
+  rlist2 = rlist * rlist
+
+  do pass = 1, 2
+
+    call region_fork ( 'neighbor_build' // c_null_char )
 !$omp parallel &
-!$omp shared ( box, nd, np, pos ) &
-!$omp private ( j )
+!$omp shared ( cell_head, cell_next, cell_width, half, lo, nbr_first, &
+!$omp   nbr_list, nc, nd, np, pass, pos, rlist2 ) &
+!$omp private ( c, cx, cy, cz, i, j, k )
 
-!$omp do
+    call region_start ( )
 
-  do j = 1, np
-    pos(1:nd,j) = box(1:nd) * pos(1:nd,j)
-  end do
+!$omp do schedule ( static )
+
+    do i = 1, np
+
+      do k = 1, 3
+        c(k) = min ( nc(k) - 1, int ( ( pos(k,i) - lo(k) ) / cell_width(k) ) )
+      end do
+!
+!  On the second pass, NBR_FIRST(I) has been set, and K is the next slot.
+!
+      if ( pass == 1 ) then
+        k = 0
+      else
+        k = nbr_first(i)
+      end if
+
+      do cz = max ( 0, c(3) - 1 ), min ( nc(3) - 1, c(3) + 1 )
+        do cy = max ( 0, c(2) - 1 ), min ( nc(2) - 1, c(2) + 1 )
+          do cx = max ( 0, c(1) - 1 ), min ( nc(1) - 1, c(1) + 1 )
+
+            j = cell_head(cx + nc(1) * ( cy + nc(2) * cz ))
+
+            do while ( j /= 0 )
+              if ( j /= i .and. ( .not. half .or. i < j ) ) then
+                if ( sum ( ( pos(1:nd,i) - pos(1:nd,j) )**2 ) < rlist2 ) then
+                  if ( pass == 2 ) then
+                    nbr_list(k) = j
+                  end if
+                  k = k + 1
+                end if
+              end if
+              j = cell_next(j)
+            end do
+
+          end do
+        end do
+      end do
+
+      if ( pass == 1 ) then
+        nbr_first(i+1) = k
+      end if
+
+    end do
+!$omp end do nowait
+    call region_work ( 'neighbor_build' // c_null_char )
+!$omp barrier
+    call region_wait ( 'neighbor_build' // c_null_char )
 
-!$omp end do
 !$omp end parallel
+    call region_join ( )
+!
+!  After counting, turn the counts into offsets.
+!
+    if ( pass == 1 ) then
+      nbr_first(1) = 1
+      do i = 1, np
+        nbr_first(i+1) = nbr_first(i) + nbr_first(i+1)
+      end do
+      nbr_num = nbr_first(np+1) - 1
+      if ( nbr_max < nbr_num ) then
+        exit
+      end if
+    end if
+
+  end do
+
+  deallocate ( cell_head )
+  deallocate ( cell_next )
+
+  return
+end
+subroutine neighbor_check ( np, nd, pos, pos_ref, skin, rebuild )
+
+!*****************************************************************************80
 !
-!  Velocities and accelerations begin at 0.
+!! NEIGHBOR_CHECK decides whether the neighbor list must be rebuilt.
 !
-!$omp parallel &
-!$omp shared ( acc, nd, np, vel )
+!  Discussion:
+!
+!    The list stays valid as long as no particle has moved more than
+!    SKIN/2 from where it was when the list was built.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP, the number of particles.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input, real ( kind = 8 ) POS(ND,NP), the position of each particle.
+!
+!    Input, real ( kind = 8 ) POS_REF(ND,NP), the positions at the last build.
+!
+!    Input, real ( kind = 8 ) SKIN, the width of the neighbor list skin.
+!
+!    Output, logical REBUILD, is TRUE if the list must be rebuilt.
+!
+  use omp_regions
+
+  implicit none
 
-!$omp workshare
+  integer ( kind = 4 ) np
+  integer ( kind = 4 ) nd
+
+  real ( kind = 8 ) d2_max
+  integer ( kind = 4 ) i
+  real ( kind = 8 ) pos(nd,np)
+  real ( kind = 8 ) pos_ref(nd,np)
+  logical rebuild
+  real ( kind = 8 ) skin
+
+  d2_max = 0.0D+00
+
+  call region_fork ( 'neighbor_check' // c_null_char )
+!$omp parallel &
+!$omp shared ( nd, np, pos, pos_ref ) &
+!$omp private ( i )
 
-  vel(1:nd,1:np) = 0.0D+00
-  acc(1:nd,1:np) = 0.0D+00
+  call region_start ( )
 
-!$omp end workshare
+!$omp do schedule ( static ) reduction ( max : d2_max )
+  do i = 1, np
+    d2_max = max ( d2_max, sum ( ( pos(1:nd,i) - pos_ref(1:nd,i) )**2 ) )
+  end do
+!$omp end do nowait
+  call region_work ( 'neighbor_check' // c_null_char )
+!$omp barrier
+  call region_wait ( 'neighbor_check' // c_null_char )
 
 !$omp end parallel
+  call region_join ( )
+
+  rebuild = ( 0.25D+00 * skin * skin < d2_max )
+
+  return
+end
+subroutine numa_report ( )
+
+!*****************************************************************************80
+!
+!! NUMA_REPORT prints how much of the process memory is on each NUMA node.
+!
+!  Discussion:
+!
+!    The counts are the N<node>=<pages> fields of /proc/self/numa_maps,
+!    times the page size of each mapping, summed over all mappings.
+!    Linux places a page on the node of the thread that first writes it,
+!    so a parallel run on a multi-socket node should show the arrays
+!    spread over the nodes of its threads.
+!
+!  Parameters:
+!
+!    None
+!
+  implicit none
+
+  integer ( kind = 4 ), parameter :: node_max = 64
+
+  integer ( kind = 4 ) e
+  integer ( kind = 4 ) ios
+  integer ( kind = 4 ) k
+  integer ( kind = 8 ) kb(0:node_max-1)
+  character ( len = 4096 ) line
+  integer ( kind = 4 ) node
+  integer ( kind = 8 ) page_kb
+  integer ( kind = 8 ) pages
+  integer ( kind = 4 ) s
+  integer ( kind = 4 ) unit
+
+  open ( newunit = unit, file = '/proc/self/numa_maps', status = 'old', &
+    action = 'read', iostat = ios )
+  if ( ios /= 0 ) then
+    write ( *, '(a)' ) '  NUMA_REPORT: /proc/self/numa_maps is not available.'
+    return
+  end if
+
+  kb(0:node_max-1) = 0
+
+  do
+
+    read ( unit, '(a)', iostat = ios ) line
+    if ( ios /= 0 ) then
+      exit
+    end if
+
+    page_kb = 4
+    k = index ( line, ' kernelpagesize_kB=' )
+    if ( 0 < k ) then
+      read ( line(k+19:), *, iostat = ios ) page_kb
+    end if
+!
+!  Each field " N<node>=<pages>".
+!
+    s = 1
+    do
+      k = index ( line(s:), ' N' )
+      if ( k == 0 ) then
+        exit
+      end if
+      s = s + k
+      e = index ( line(s:), '=' )
+      if ( e < 3 ) then
+        cycle
+      end if
+      read ( line(s+1:s+e-2), *, iostat = ios ) node
+      if ( ios /= 0 .or. node < 0 .or. node_max <= node ) then
+        cycle
+      end if
+      k = index ( line(s+e:), ' ' )
+      read ( line(s+e:s+e+k-2), *, iostat = ios ) pages
+      if ( ios == 0 ) then
+        kb(node) = kb(node) + pages * page_kb
+      end if
+    end do
+
+  end do
+
+  close ( unit )
+
+  write ( *, '(a)' ) ' '
+  write ( *, '(a)' ) '  Memory on each NUMA node:'
+  do node = 0, node_max - 1
+    if ( 0 < kb(node) ) then
+      write ( *, '(a,i4,a,f12.1,a)' ) '    Node ', node, ': ', &
+        real ( kb(node), kind = 8 ) / 1024.0D+00, ' MiB'
+    end if
+  end do
+
+  return
+end
+subroutine option_get ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET returns the value of a run time option.
+!
+!  Discussion:
+!
+!    The option NAME may be given on the command line as NAME=VALUE, or
+!    in the environment variable ENV_NAME.  The command line takes
+!    precedence.  If the option is not given, VALUE is unchanged.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, character ( len = * ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = 255 ) arg
+  character ( len = * ) env_name
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) k
+  integer ( kind = 4 ) length
+  character ( len = * ) name
+  integer ( kind = 4 ) status
+  character ( len = * ) value
+
+  do i = 1, command_argument_count ( )
+    call get_command_argument ( i, arg )
+    k = index ( arg, '=' )
+    if ( 1 < k ) then
+      if ( arg(1:k-1) == name ) then
+        value = arg(k+1:)
+        return
+      end if
+    end if
+  end do
+
+  call get_environment_variable ( env_name, arg, length, status )
+  if ( status == 0 .and. 0 < length ) then
+    value = arg
+  end if
+
+  return
+end
+subroutine option_get_i4 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_I4 returns the value of an integer run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, integer ( kind = 4 ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  integer ( kind = 4 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_I4 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      stop 1
+    end if
+  end if
+
+  return
+end
+subroutine option_get_r8 ( name, env_name, value )
+
+!*****************************************************************************80
+!
+!! OPTION_GET_R8 returns the value of a real run time option.
+!
+!  Parameters:
+!
+!    Input, character ( len = * ) NAME, the name of the option.
+!
+!    Input, character ( len = * ) ENV_NAME, the environment variable.
+!
+!    Input/output, real ( kind = 8 ) VALUE, the value of the option.
+!
+  implicit none
+
+  character ( len = * ) env_name
+  integer ( kind = 4 ) ios
+  character ( len = * ) name
+  character ( len = 255 ) string
+  real ( kind = 8 ) value
+
+  string = ' '
+  call option_get ( name, env_name, string )
+
+  if ( len_trim ( string ) /= 0 ) then
+    read ( string, *, iostat = ios ) value
+    if ( ios /= 0 ) then
+      write ( *, '(a)' ) ' '
+      write ( *, '(a)' ) 'OPTION_GET_R8 - Fatal error!'
+      write ( *, '(a,a,a,a)' ) '  Bad value for ', name, ': ', trim ( string )
+      stop 1
+    end if
+  end if
+
+  return
+end
+function r8_uniform_01 ( seed )
+
+!*****************************************************************************80
+!
+!! R8_UNIFORM_01 returns a unit pseudorandom R8.
+!
+!  Discussion:
+!
+!    This routine implements the recursion
+!
+!      seed = 16807 * seed mod ( 2**31 - 1 )
+!      r8_uniform_01 = seed / ( 2**31 - 1 )
+!
+!    The integer arithmetic never requires more than 32 bits,
+!    including a sign bit.
+!
+!  Licensing:
+!
+!    This code is distributed under the GNU LGPL license.
+!
+!  Modified:
+!
+!    05 July 2006
+!
+!  Author:
+!
+!    John Burkardt
+!
+!  Parameters:
+!
+!    Input/output, integer ( kind = 4 ) SEED, the "seed" value, which should
+!    NOT be 0.  On output, SEED has been updated.
+!
+!    Output, real ( kind = 8 ) R8_UNIFORM_01, a new pseudorandom variate,
+!    strictly between 0 and 1.
+!
+  implicit none
+
+  integer ( kind = 4 ), parameter :: i4_huge = 2147483647
+  integer ( kind = 4 ) k
+  real ( kind = 8 ) r8_uniform_01
+  integer ( kind = 4 ) seed
+
+  if ( seed == 0 ) then
+    write ( *, '(a)' ) ' '
+    write ( *, '(a)' ) 'R8_UNIFORM_01 - Fatal error!'
+    write ( *, '(a)' ) '  Input value of SEED = 0.'
+    stop 1
+  end if
+
+  k = seed / 127773
+
+  seed = 16807 * ( seed - k * 127773 ) - k * 2836
+
+  if ( seed < 0 ) then
+    seed = seed + i4_huge
+  end if
+
+  r8_uniform_01 = real ( seed, kind = 8 ) * 4.656612875D-10
 
   return
 end
@@ -519,6 +2447,8 @@ subroutine update ( np, nd, pos, vel, f, acc, mass, dt )
 !
 !    Input, real ( kind = 8 ) DT, the time step.
 !
+  use omp_regions
+
   implicit none
 
   integer ( kind = 4 ) np
@@ -536,11 +2466,14 @@ subroutine update ( np, nd, pos, vel, f, acc, mass, dt )
 
   rmass = 1.0D+00 / mass
 
+  call region_fork ( 'update' // c_null_char )
 !$omp parallel &
 !$omp shared ( acc, dt, f, nd, np, pos, rmass, vel ) &
 !$omp private ( i, j )
 
-!$omp do
+  call region_start ( )
+
+!$omp do schedule ( static )
   do j = 1, np
     do i = 1, nd
       pos(i,j) = pos(i,j) + vel(i,j) * dt + 0.5D+00 * acc(i,j) * dt * dt
@@ -548,9 +2481,92 @@ subroutine update ( np, nd, pos, vel, f, acc, mass, dt )
       acc(i,j) = f(i,j) * rmass
     end do
   end do
-!$omp end do
+!$omp end do nowait
+  call region_work ( 'update' // c_null_char )
+!$omp barrier
+  call region_wait ( 'update' // c_null_char )
+
+!$omp end parallel
+  call region_join ( )
+
+  return
+end
+subroutine update_soa ( np_pad, nd, pos, vel, f, acc, mass, dt )
+
+!*****************************************************************************80
+!
+!! UPDATE_SOA updates positions, velocities and accelerations, SOA layout.
+!
+!  Discussion:
+!
+!    This is UPDATE for arrays whose column K holds coordinate K of every
+!    particle.  Each column is updated by a SIMD loop over the particles,
+!    with the same static partition for every column.  The padding rows
+!    are updated too; they stay 0.
+!
+!  Parameters:
+!
+!    Input, integer ( kind = 4 ) NP_PAD, the leading dimension of the
+!    arrays.
+!
+!    Input, integer ( kind = 4 ) ND, the number of spatial dimensions.
+!
+!    Input/output, real ( kind = 8 ) POS(NP_PAD,ND), the position of each
+!    particle.
+!
+!    Input/output, real ( kind = 8 ) VEL(NP_PAD,ND), the velocity of each
+!    particle.
+!
+!    Input, real ( kind = 8 ) F(NP_PAD,ND), the force on each particle.
+!
+!    Input/output, real ( kind = 8 ) ACC(NP_PAD,ND), the acceleration of
+!    each particle.
+!
+!    Input, real ( kind = 8 ) MASS, the mass of each particle.
+!
+!    Input, real ( kind = 8 ) DT, the time step.
+!
+  use omp_regions
+
+  implicit none
+
+  integer ( kind = 4 ) nd
+  integer ( kind = 4 ) np_pad
+
+  real ( kind = 8 ) acc(np_pad,nd)
+  real ( kind = 8 ) dt
+  real ( kind = 8 ) f(np_pad,nd)
+  integer ( kind = 4 ) i
+  integer ( kind = 4 ) j
+  real ( kind = 8 ) mass
+  real ( kind = 8 ) pos(np_pad,nd)
+  real ( kind = 8 ) rmass
+  real ( kind = 8 ) vel(np_pad,nd)
+
+  rmass = 1.0D+00 / mass
+
+  call region_fork ( 'update_soa' // c_null_char )
+!$omp parallel &
+!$omp shared ( acc, dt, f, nd, np_pad, pos, rmass, vel ) &
+!$omp private ( i, j )
+
+  call region_start ( )
+
+  do i = 1, nd
+!$omp do simd schedule ( static )
+    do j = 1, np_pad
+      pos(j,i) = pos(j,i) + vel(j,i) * dt + 0.5D+00 * acc(j,i) * dt * dt
+      vel(j,i) = vel(j,i) + 0.5D+00 * dt * ( f(j,i) * rmass + acc(j,i) )
+      acc(j,i) = f(j,i) * rmass
+    end do
+!$omp end do simd nowait
+  end do
+  call region_work ( 'update_soa' // c_null_char )
+!$omp barrier
+  call region_wait ( 'update_soa' // c_null_char )
 
 !$omp end parallel
+  call region_join ( )
 
   return
 end
@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+"""
+Reader for the binary trajectories written by md_openmp.f90 (TRAJECTORY=K).
+
+The format is described in trajectory.h.  As a program, it lists the
+frames of a file, with the first particle's position and velocity:
+
+    python md_trajectory.py md.traj
+
+As a module, frames(path) yields (step, pos, vel) for each frame, POS and
+VEL being lists of ND lists of NP floats.
+"""
+
+import struct
+import sys
+import zlib
+
+QUANTIZED, DELTA, ZLIB = 1, 2, 4
+FILE_MAGIC = b"MDTRAJ01"
+FRAME_MAGIC = b"MDFRAME1"
+
+
+def varints(data, count):
+    """Decode COUNT zigzag varints from DATA."""
+    values = [0] * count
+    shift = z = k = 0
+    for byte in data:
+        z |= (byte & 0x7F) << shift
+        if byte & 0x80:
+            shift += 7
+            continue
+        values[k] = (z >> 1) ^ -(z & 1)
+        k += 1
+        shift = z = 0
+    if k != count:
+        raise ValueError("frame has %d values, not %d" % (k, count))
+    return values
+
+
+def frames(path):
+    with open(path, "rb") as f:
+        head = f.read(40)
+        if len(head) < 40 or head[:8] != FILE_MAGIC:
+            raise ValueError("%s is not a trajectory" % path)
+        np, nd, _ = struct.unpack("=3q", head[8:32])
+        (quantum,) = struct.unpack("=d", head[32:40])
+        count = 2 * nd * np
+        prev = None
+        while True:
+            word = f.read(40)
+            if len(word) < 40:
+                return
+            if word[:8] != FRAME_MAGIC:
+                raise ValueError("%s: bad frame" % path)
+            step, flags, raw, size = struct.unpack("=4q", word[8:40])
+            payload = f.read(size)
+            if flags & ZLIB:
+                payload = zlib.decompress(payload)
+            if len(payload) != raw:
+                raise ValueError("%s: truncated frame" % path)
+            if flags & DELTA and prev is None:
+                # Started after a keyframe was lost; skip to the next one.
+                continue
+            if flags & QUANTIZED:
+                q = varints(payload, count)
+                if flags & DELTA:
+                    q = [a + b for a, b in zip(prev, q)]
+                prev = q
+                values = [x * quantum for x in q]
+            else:
+                bits = struct.unpack("=%dQ" % count, payload)
+                if flags & DELTA:
+                    bits = [a ^ b for a, b in zip(prev, bits)]
+                prev = bits
+                values = struct.unpack("=%dd" % count,
+                                       struct.pack("=%dQ" % count, *bits))
+            rows = [list(values[c * np:(c + 1) * np]) for c in range(2 * nd)]
+            yield step, rows[:nd], rows[nd:]
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: md_trajectory.py FILE")
+    print("%8s  %s" % ("step", "particle 1: position, velocity"))
+    for step, pos, vel in frames(sys.argv[1]):
+        print("%8d  %s  %s" % (step,
+                               " ".join("%12.6g" % c[0] for c in pos),
+                               " ".join("%12.6g" % c[0] for c in vel)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,203 @@
+/*
+ * The region timers of omp_regions.h.
+ *
+ *   gcc -O3 -fopenmp -c omp_regions.c
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+#include "omp_regions.h"
+
+#define REGIONS_MAX 64
+#define NAME_LEN 32
+
+/* One thread's totals, padded to a cache line against false sharing. */
+typedef struct {
+    double busy, wait, fork;
+    char pad[64 - 3 * sizeof(double)];
+} thread_times;
+
+typedef struct {
+    char name[NAME_LEN];
+    long forks;                 /* times the region was entered */
+    long loops;                 /* times the loop was done */
+    double join;
+    thread_times *t;
+} region;
+
+/* Each thread's last mark. */
+typedef struct {
+    double last;
+    char pad[64 - sizeof(double)];
+} thread_mark;
+
+static int enabled;
+static int threads;
+static region regions[REGIONS_MAX];
+static int region_num;
+static thread_mark *marks;
+static int current = -1;        /* the region being run */
+static double fork_time;
+
+static void *allocate(size_t bytes)
+{
+    void *p = calloc(1, bytes);
+
+    if (p == NULL) {
+        fprintf(stderr, "omp_regions: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* The index of NAME, which is added if it is new. */
+static int find(const char *name)
+{
+    int k, num = __atomic_load_n(&region_num, __ATOMIC_ACQUIRE);
+
+    for (k = 0; k < num; ++k) {
+        if (strcmp(regions[k].name, name) == 0) {
+            return k;
+        }
+    }
+#pragma omp critical (omp_regions)
+    {
+        num = region_num;
+        for (k = 0; k < num; ++k) {
+            if (strcmp(regions[k].name, name) == 0) {
+                break;
+            }
+        }
+        if (k == num && num < REGIONS_MAX) {
+            strncpy(regions[k].name, name, NAME_LEN - 1);
+            regions[k].t = allocate(threads * sizeof(thread_times));
+            __atomic_store_n(&region_num, num + 1, __ATOMIC_RELEASE);
+        } else if (k == num) {
+            k = REGIONS_MAX - 1;
+        }
+    }
+    return k;
+}
+
+void regions_init(int on)
+{
+    enabled = on;
+    threads = omp_get_max_threads();
+    marks = allocate(threads * sizeof(thread_mark));
+}
+
+void region_fork(const char *name)
+{
+    if (!enabled) {
+        return;
+    }
+    current = find(name);
+    fork_time = omp_get_wtime();
+}
+
+void region_start(void)
+{
+    int id = omp_get_thread_num();
+    double now;
+
+    if (!enabled || id >= threads) {
+        return;
+    }
+    now = omp_get_wtime();
+    regions[current].t[id].fork += now - fork_time;
+    marks[id].last = now;
+}
+
+void region_work(const char *name)
+{
+    int id = omp_get_thread_num();
+    region *r;
+    double now;
+
+    if (!enabled || id >= threads) {
+        return;
+    }
+    now = omp_get_wtime();
+    r = &regions[find(name)];
+    r->t[id].busy += now - marks[id].last;
+    marks[id].last = now;
+    if (id == 0) {
+        r->loops += 1;
+    }
+}
+
+void region_wait(const char *name)
+{
+    int id = omp_get_thread_num();
+    double now;
+
+    if (!enabled || id >= threads) {
+        return;
+    }
+    now = omp_get_wtime();
+    regions[find(name)].t[id].wait += now - marks[id].last;
+    marks[id].last = now;
+}
+
+void region_join(void)
+{
+    double now;
+
+    if (!enabled) {
+        return;
+    }
+    now = omp_get_wtime();
+    regions[current].forks += 1;
+    regions[current].join += now - marks[0].last;
+    current = -1;
+}
+
+void regions_report(void)
+{
+    int k, i;
+
+    if (!enabled) {
+        return;
+    }
+    printf("\n");
+    printf("  OpenMP regions, seconds summed over the calls, "
+           "averaged over %d threads:\n", threads);
+    printf("  %-28s %8s %9s %9s %6s %9s %9s %9s %9s\n", "region", "calls",
+           "busy", "busy max", "imbal", "wait", "wait max", "fork", "join");
+    for (k = 0; k < region_num; ++k) {
+        region *r = &regions[k];
+        double busy = 0.0, busy_max = 0.0, wait = 0.0, wait_max = 0.0;
+        double fork = 0.0;
+
+        for (i = 0; i < threads; ++i) {
+            busy += r->t[i].busy;
+            wait += r->t[i].wait;
+            fork += r->t[i].fork;
+            if (busy_max < r->t[i].busy) {
+                busy_max = r->t[i].busy;
+            }
+            if (wait_max < r->t[i].wait) {
+                wait_max = r->t[i].wait;
+            }
+        }
+        busy /= threads;
+        wait /= threads;
+        fork /= threads;
+
+        printf("  %-28s %8ld", r->name, r->loops ? r->loops : r->forks);
+        if (r->loops) {
+            printf(" %9.4f %9.4f %6.2f %9.4f %9.4f", busy, busy_max,
+                   busy > 0.0 ? busy_max / busy : 1.0, wait, wait_max);
+        } else {
+            printf(" %9s %9s %6s %9s %9s", "", "", "", "", "");
+        }
+        if (r->forks) {
+            printf(" %9.4f %9.4f", fork, r->join);
+        }
+        printf("\n");
+    }
+    printf("  imbal is busy max / busy; fork and join are the team's "
+           "start and end.\n");
+    fflush(stdout);
+}
@@ -0,0 +1,62 @@
+#ifndef OMP_REGIONS_H
+#define OMP_REGIONS_H
+
+/*
+ * Timers for OpenMP parallel regions and the loops inside them, to show
+ * where the time goes as the number of threads grows.
+ *
+ * A parallel region is marked like this (in Fortran):
+ *
+ *   call region_fork ( 'jacobi' // c_null_char )
+ *   !$omp parallel
+ *   call region_start ( )
+ *   !$omp do
+ *   ...
+ *   !$omp end do nowait
+ *   call region_work ( 'jacobi copy' // c_null_char )
+ *   !$omp barrier
+ *   call region_wait ( 'jacobi copy' // c_null_char )
+ *   ...
+ *   !$omp end parallel
+ *   call region_join ( )
+ *
+ * so that each thread's time is split into:
+ *
+ *   fork, from region_fork() on the master thread to region_start() on
+ *   the thread, the cost of starting the team;
+ *
+ *   busy, from the thread's previous mark to region_work(), its share of
+ *   the loop;
+ *
+ *   wait, from region_work() to region_wait(), the time spent in the
+ *   barrier waiting for the slower threads;
+ *
+ *   join, from the master thread's last mark to region_join(), the cost
+ *   of ending the team.
+ *
+ * The names are looked up at every call, so a region or loop may be
+ * marked from several places.  The marks do nothing unless
+ * regions_init() was called with ENABLED, and regions_report() prints
+ * the totals per region and loop.  Regions must not be nested.
+ */
+void regions_init(int enabled);
+
+/* Called by the master thread just before the parallel region NAME. */
+void region_fork(const char *name);
+
+/* Called by every thread first thing in the region. */
+void region_start(void);
+
+/* Called by every thread when its share of the loop NAME is done. */
+void region_work(const char *name);
+
+/* Called by every thread after the barrier that ends the loop NAME. */
+void region_wait(const char *name);
+
+/* Called by the master thread just after the region. */
+void region_join(void);
+
+/* Print the table of regions and loops on standard output. */
+void regions_report(void);
+
+#endif
@@ -1,26 +1,373 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <omp.h>
-#define NSTEPS  5000000000 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+#define NSTEPS  5000000000
 
-long i,num_steps=NSTEPS;
-double x,step,sum,pi;
 
+/*
+ * Return the value of option NAME, given on the command line as NAME=VALUE
+ * or in the environment variable ENV_NAME, or NULL if it is not set.
+ * The command line takes precedence.
+ */
+static const char *option_string(int argc, char **argv, const char *name,
+                                 const char *env_name)
+{
+    size_t len = strlen(name);
+    const char *value = NULL;
+    int k;
 
-int main(int argc, char **argv)
+    for (k = 1; k < argc; ++k) {
+        if (strncmp(argv[k], name, len) == 0 && argv[k][len] == '=') {
+            value = argv[k] + len + 1;
+        }
+    }
+    if (value == NULL) {
+        value = getenv(env_name);
+    }
+    if (value != NULL && *value == '\0') {
+        value = NULL;
+    }
+    return value;
+}
+
+/*
+ * Return the value of the integer option NAME (see option_string), or
+ * DEFAULT_VALUE if it is not set.
+ */
+static long option_long(int argc, char **argv, const char *name,
+                        const char *env_name, long default_value)
+{
+    const char *value = option_string(argc, argv, name, env_name);
+    char *end;
+    long result;
+
+    if (value == NULL) {
+        return default_value;
+    }
+    result = strtol(value, &end, 10);
+    if (*end != '\0' || result <= 0) {
+        fprintf(stderr, "Bad value for %s: %s\n", name, value);
+        exit(1);
+    }
+    return result;
+}
+
+/*
+ * Each kernel returns the sum of 4/(1+x*x), x = (i+0.5)*step, over
+ * lo <= i < hi.
+ */
+typedef double (*pi_kernel)(long lo, long hi, double step);
+
+/* The original loop: one accumulator, so one divide in flight. */
+static double pi_scalar(long lo, long hi, double step)
 {
-x=0;
-sum = 0.0;
-step = 1.0/(double) num_steps;
-#pragma omp parallel private(i,x) shared(sum)
+    double x, sum = 0.0;
+    long i;
+
+    for (i = lo; i < hi; ++i) {
+        x = (i+0.5)*step;
+        sum = sum + 4.0/(1.0+x*x);
+    }
+    return sum;
+}
+
+/*
+ * Portable vector version: four interleaved streams, each vectorized by
+ * the compiler, so that several divides are in flight at once.
+ */
+static double pi_simd(long lo, long hi, double step)
 {
-#pragma omp for schedule(static) reduction(+:sum)
-for (i=0; i < num_steps; ++i) {
-       x = (i+0.5)*step;
-       sum = sum+ 4.0/(1.0+x*x);
+    long q = (hi - lo) / 4;
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    long k;
+
+#pragma omp simd reduction(+:s0,s1,s2,s3)
+    for (k = 0; k < q; ++k) {
+        double x0 = (lo + k + 0.5)*step;
+        double x1 = (lo + q + k + 0.5)*step;
+        double x2 = (lo + 2*q + k + 0.5)*step;
+        double x3 = (lo + 3*q + k + 0.5)*step;
+        s0 += 4.0/(1.0+x0*x0);
+        s1 += 4.0/(1.0+x1*x1);
+        s2 += 4.0/(1.0+x2*x2);
+        s3 += 4.0/(1.0+x3*x3);
+    }
+    return (s0 + s1) + (s2 + s3) + pi_scalar(lo + 4*q, hi, step);
 }
+
+#ifdef HAVE_X86_KERNELS
+
+/*
+ * AVX2 versions: four accumulators of four terms each.  The _rcp variant
+ * replaces the divide by a single precision reciprocal estimate (12 bits)
+ * and three Newton steps r = r*(2 - d*r), each doubling the correct bits.
+ */
+#define PI_AVX2_BODY(RECIP)                                                 \
+    __m256d vstep = _mm256_set1_pd(step);                                   \
+    __m256d one = _mm256_set1_pd(1.0), two = _mm256_set1_pd(2.0);           \
+    __m256d four = _mm256_set1_pd(4.0), inc = _mm256_set1_pd(16.0);         \
+    __m256d s[4], idx[4];                                                   \
+    double part[4];                                                         \
+    long i = lo;                                                            \
+    int u;                                                                  \
+    (void) two;                                                             \
+    for (u = 0; u < 4; ++u) {                                               \
+        double b = lo + 4*u + 0.5;                                          \
+        s[u] = _mm256_setzero_pd();                                         \
+        idx[u] = _mm256_set_pd(b + 3, b + 2, b + 1, b);                     \
+    }                                                                       \
+    for (; i + 16 <= hi; i += 16) {                                         \
+        for (u = 0; u < 4; ++u) {                                           \
+            __m256d x = _mm256_mul_pd(idx[u], vstep);                       \
+            __m256d d = _mm256_fmadd_pd(x, x, one);                         \
+            RECIP                                                           \
+            idx[u] = _mm256_add_pd(idx[u], inc);                            \
+        }                                                                   \
+    }                                                                       \
+    s[0] = _mm256_add_pd(_mm256_add_pd(s[0], s[1]),                         \
+                         _mm256_add_pd(s[2], s[3]));                        \
+    _mm256_storeu_pd(part, s[0]);                                           \
+    return (part[0] + part[1]) + (part[2] + part[3])                        \
+        + pi_scalar(i, hi, step);
+
+__attribute__((target("avx2,fma")))
+static double pi_avx2(long lo, long hi, double step)
+{
+    PI_AVX2_BODY(
+        s[u] = _mm256_add_pd(s[u], _mm256_div_pd(four, d));
+    )
+}
+
+__attribute__((target("avx2,fma")))
+static double pi_avx2_rcp(long lo, long hi, double step)
+{
+    PI_AVX2_BODY(
+        __m256d r = _mm256_cvtps_pd(_mm_rcp_ps(_mm256_cvtpd_ps(d)));
+        r = _mm256_mul_pd(r, _mm256_fnmadd_pd(d, r, two));
+        r = _mm256_mul_pd(r, _mm256_fnmadd_pd(d, r, two));
+        r = _mm256_mul_pd(r, _mm256_fnmadd_pd(d, r, two));
+        s[u] = _mm256_fmadd_pd(four, r, s[u]);
+    )
+}
+
+/*
+ * AVX-512 versions: four accumulators of eight terms each.  rcp14 gives
+ * 14 bits, so two Newton steps reach double precision.
+ */
+#define PI_AVX512_BODY(RECIP)                                               \
+    __m512d vstep = _mm512_set1_pd(step);                                   \
+    __m512d one = _mm512_set1_pd(1.0), two = _mm512_set1_pd(2.0);           \
+    __m512d four = _mm512_set1_pd(4.0), inc = _mm512_set1_pd(32.0);         \
+    __m512d s[4], idx[4];                                                   \
+    long i = lo;                                                            \
+    int u;                                                                  \
+    (void) two;                                                             \
+    for (u = 0; u < 4; ++u) {                                               \
+        double b = lo + 8*u + 0.5;                                          \
+        s[u] = _mm512_setzero_pd();                                         \
+        idx[u] = _mm512_set_pd(b + 7, b + 6, b + 5, b + 4,                  \
+                               b + 3, b + 2, b + 1, b);                     \
+    }                                                                       \
+    for (; i + 32 <= hi; i += 32) {                                         \
+        for (u = 0; u < 4; ++u) {                                           \
+            __m512d x = _mm512_mul_pd(idx[u], vstep);                       \
+            __m512d d = _mm512_fmadd_pd(x, x, one);                         \
+            RECIP                                                           \
+            idx[u] = _mm512_add_pd(idx[u], inc);                            \
+        }                                                                   \
+    }                                                                       \
+    s[0] = _mm512_add_pd(_mm512_add_pd(s[0], s[1]),                         \
+                         _mm512_add_pd(s[2], s[3]));                        \
+    return _mm512_reduce_add_pd(s[0]) + pi_scalar(i, hi, step);
+
+__attribute__((target("avx512f")))
+static double pi_avx512(long lo, long hi, double step)
+{
+    PI_AVX512_BODY(
+        s[u] = _mm512_add_pd(s[u], _mm512_div_pd(four, d));
+    )
+}
+
+__attribute__((target("avx512f")))
+static double pi_avx512_rcp(long lo, long hi, double step)
+{
+    PI_AVX512_BODY(
+        __m512d r = _mm512_rcp14_pd(d);
+        r = _mm512_mul_pd(r, _mm512_fnmadd_pd(d, r, two));
+        r = _mm512_mul_pd(r, _mm512_fnmadd_pd(d, r, two));
+        s[u] = _mm512_fmadd_pd(four, r, s[u]);
+    )
 }
+
+#endif
+
+#ifdef __SIZEOF_INT128__
+
+/*
+ * Reproducible sum.  Every term lies in [2,4], where doubles are spaced
+ * 2^-51 apart, so the sum is kept exactly as a 128 bit integer count of
+ * 2^-51 units.  Integer addition is associative, so the result has the
+ * same bits for any number of threads or ranks, and is rounded only once,
+ * when converted back to double.
+ */
+typedef __int128 pi_fixed;
+
+#pragma omp declare reduction(fixed_add : pi_fixed : omp_out += omp_in) \
+    initializer(omp_priv = 0)
+
+/* Terms per 64 bit partial sum: each term contributes at most 2^52. */
+#define EXACT_CHUNK 1024
+
+static pi_fixed pi_exact(long lo, long hi, double step)
+{
+    const int64_t two_bits = 0x4000000000000000;   /* bits of 2.0 */
+    pi_fixed total = 0;
+    long i;
+
+    for (i = lo; i < hi; i += EXACT_CHUNK) {
+        int count = hi - i < EXACT_CHUNK ? hi - i : EXACT_CHUNK;
+        double base = i + 0.5;
+        int64_t part = 0;
+        int k;
+
+        /*
+         * For t in [2,4], the bits of t less the bits of 2.0 are
+         * (t - 2) * 2^51, exactly.  base + k is exactly i + k + 0.5, and
+         * converting the int k vectorizes where a long would not.
+         */
+#pragma omp simd reduction(+:part)
+        for (k = 0; k < count; ++k) {
+            double x = (base + k)*step;
+            double t = 4.0/(1.0+x*x);
+            int64_t bits;
+
+            memcpy(&bits, &t, sizeof(bits));
+            part += bits - two_bits;
+        }
+        total += part + ((pi_fixed) count << 52);
+    }
+    return total;
+}
+
+#endif
+
+static const struct {
+    const char *name;
+    pi_kernel kernel;
+} kernels[] = {
+    { "scalar", pi_scalar },
+    { "simd", pi_simd },
+#ifdef HAVE_X86_KERNELS
+    { "avx2", pi_avx2 },
+    { "avx2-rcp", pi_avx2_rcp },
+    { "avx512", pi_avx512 },
+    { "avx512-rcp", pi_avx512_rcp },
+#endif
+};
+
+/*
+ * Pick the kernel called NAME, or for "auto" (or NULL) the widest one this
+ * processor supports.
+ */
+static const char *select_kernel(const char *name, pi_kernel *kernel)
+{
+    size_t k;
+
+    if (name == NULL || strcmp(name, "auto") == 0) {
+        name = "simd";
+#ifdef HAVE_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            name = "avx512";
+        } else if (__builtin_cpu_supports("avx2")
+                   && __builtin_cpu_supports("fma")) {
+            name = "avx2";
+        }
+#endif
+    }
+    for (k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k) {
+        if (strcmp(name, kernels[k].name) == 0) {
+            *kernel = kernels[k].kernel;
+            return kernels[k].name;
+        }
+    }
+    fprintf(stderr, "Unknown kernel %s; choose auto", name);
+    for (k = 0; k < sizeof(kernels)/sizeof(kernels[0]); ++k) {
+        fprintf(stderr, ", %s", kernels[k].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    long num_steps;
+    double step, sum, pi, wtime;
+    pi_kernel kernel;
+    const char *name, *sum_mode;
+    int threads = 1;
+
+    num_steps = option_long(argc, argv, "steps", "PI_STEPS", NSTEPS);
+    name = select_kernel(option_string(argc, argv, "kernel", "PI_KERNEL"),
+                         &kernel);
+    sum_mode = option_string(argc, argv, "sum", "PI_SUM");
+    if (sum_mode == NULL) {
+        sum_mode = "plain";
+    }
+    sum = 0.0;
+    step = 1.0/(double) num_steps;
+
+    wtime = omp_get_wtime();
+    if (strcmp(sum_mode, "plain") == 0) {
+#pragma omp parallel reduction(+:sum)
+        {
+            long nt = omp_get_num_threads(), t = omp_get_thread_num();
+            long rem = num_steps % nt;
+            long lo = num_steps / nt * t + (t < rem ? t : rem);
+            long hi = lo + num_steps / nt + (t < rem);
+
+            sum = kernel(lo, hi, step);
+#pragma omp master
+            threads = nt;
+        }
+#ifdef __SIZEOF_INT128__
+    } else if (strcmp(sum_mode, "exact") == 0) {
+        pi_fixed fixed = 0;
+
+        name = "exact";
+#pragma omp parallel reduction(fixed_add:fixed)
+        {
+            long nt = omp_get_num_threads(), t = omp_get_thread_num();
+            long rem = num_steps % nt;
+            long lo = num_steps / nt * t + (t < rem ? t : rem);
+            long hi = lo + num_steps / nt + (t < rem);
+
+            fixed = pi_exact(lo, hi, step);
+#pragma omp master
+            threads = nt;
+        }
+        sum = (double) fixed * 0x1p-51;
+#endif
+    } else {
+        fprintf(stderr, "Unknown sum %s; choose plain", sum_mode);
+#ifdef __SIZEOF_INT128__
+        fprintf(stderr, " or exact");
+#endif
+        fprintf(stderr, "\n");
+        exit(1);
+    }
+    wtime = omp_get_wtime() - wtime;
+
     pi = step * sum;
-printf("Computed PI %.24f\n", pi);
-return 0;
+    printf("Computed PI %.24f\n", pi);
+    printf("Kernel %s, %d threads, %.6f s, %.4g terms/s, %.4g terms/s/thread\n",
+           name, threads, wtime, num_steps / wtime,
+           num_steps / wtime / threads);
+    return 0;
 }
@@ -0,0 +1,280 @@
+/*
+ * The trajectory writer of trajectory.h.
+ *
+ *   gcc -O3 -fopenmp -c async_io.c
+ *   gcc -O3 -fopenmp -DHAVE_ZLIB -c trajectory.c
+ *   gfortran -O3 -fopenmp -o md_f90 md_openmp.f90 trajectory.o async_io.o \
+ *     -lz -lpthread
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <omp.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "async_io.h"
+#include "trajectory.h"
+
+#define WORDS 5
+
+struct trajectory {
+    async_io *io;
+    char *path;
+    int np, nd, flags;
+    double quantum;
+    long frames;                /* frames encoded since the open */
+    uint64_t *prev;             /* the previous frame's values */
+    unsigned char *payload;     /* the payload before compression */
+    unsigned char *frame;       /* the frame as written */
+    size_t payload_max, frame_max;
+    double encode_seconds;      /* writer thread */
+    double call_seconds;        /* calling thread */
+};
+
+static const char file_magic[8] = "MDTRAJ01";
+static const char frame_magic[8] = "MDFRAME1";
+
+static void *allocate(size_t bytes)
+{
+    void *p = malloc(bytes);
+
+    if (p == NULL) {
+        fprintf(stderr, "trajectory: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* Store X as a zigzag varint at P; return the end. */
+static unsigned char *put_varint(unsigned char *p, uint64_t x)
+{
+    uint64_t z = (x << 1) ^ (uint64_t) ((int64_t) x >> 63);
+
+    while (z >= 0x80) {
+        *p++ = (unsigned char) (z | 0x80);
+        z >>= 7;
+    }
+    *p++ = (unsigned char) z;
+    return p;
+}
+
+/*
+ * The async_io filter: turn the raw frame queued by trajectory_write()
+ * into the frame of the file.  Runs in the writer thread, one frame at a
+ * time and in step order, so PREV needs no lock.
+ */
+static size_t encode(void *arg, const char *data, size_t size,
+                     const char **out)
+{
+    trajectory *t = arg;
+    int64_t head[4], word[WORDS];
+    const double *pos, *vel, *a;
+    long np = t->np, nd = t->nd, ld, i, v;
+    unsigned char *start, *p;
+    uint64_t *prev = t->prev, x;
+    double time = omp_get_wtime(), rq;
+    int flags = t->flags, soa;
+    size_t raw, bytes;
+
+    (void) size;
+    memcpy(head, data, sizeof(head));
+    ld = head[1];
+    soa = (int) head[2];
+    pos = (const double *) (data + sizeof(head));
+    vel = pos + (soa ? ld * nd : ld * np);
+
+    if (t->frames % TRAJECTORY_KEYFRAME != 0) {
+        flags |= TRAJECTORY_DELTA;
+    }
+    rq = flags & TRAJECTORY_QUANTIZED ? 1.0 / t->quantum : 0.0;
+
+    /* Without compression, the payload is built in place. */
+    start = flags & TRAJECTORY_ZLIB ? t->payload : t->frame + sizeof(word);
+    p = start;
+    for (v = 0; v < 2 * nd; ++v) {
+        long c = v % nd;
+        long stride = soa ? 1 : ld;
+
+        a = (v < nd ? pos : vel) + (soa ? c * ld : c);
+        if (flags & TRAJECTORY_QUANTIZED) {
+            for (i = 0; i < np; ++i) {
+                x = (uint64_t) llround(a[i * stride] * rq);
+                p = put_varint(p, flags & TRAJECTORY_DELTA ? x - prev[i] : x);
+                prev[i] = x;
+            }
+        } else {
+            for (i = 0; i < np; ++i) {
+                memcpy(&x, &a[i * stride], sizeof(x));
+                if (flags & TRAJECTORY_DELTA) {
+                    uint64_t d = x ^ prev[i];
+
+                    memcpy(p, &d, sizeof(d));
+                } else {
+                    memcpy(p, &x, sizeof(x));
+                }
+                p += sizeof(x);
+                prev[i] = x;
+            }
+        }
+        prev += np;
+    }
+    raw = p - start;
+    bytes = raw;
+
+#ifdef HAVE_ZLIB
+    if (flags & TRAJECTORY_ZLIB) {
+        uLongf len = t->frame_max - sizeof(word);
+
+        if (compress2(t->frame + sizeof(word), &len, t->payload, raw,
+                      Z_BEST_SPEED) == Z_OK && len < raw) {
+            bytes = len;
+        } else {
+            flags &= ~TRAJECTORY_ZLIB;
+            memcpy(t->frame + sizeof(word), t->payload, raw);
+        }
+    }
+#endif
+
+    memcpy(&word[0], frame_magic, sizeof(word[0]));
+    word[1] = head[0];
+    word[2] = flags;
+    word[3] = raw;
+    word[4] = bytes;
+    memcpy(t->frame, word, sizeof(word));
+
+    t->frames += 1;
+    t->encode_seconds += omp_get_wtime() - time;
+    *out = (const char *) t->frame;
+    return sizeof(word) + bytes;
+}
+
+/* Does PATH start with the header of a trajectory like T? */
+static int same_header(const char *path, const trajectory *t)
+{
+    int64_t word[WORDS];
+    double quantum;
+    FILE *f = fopen(path, "rb");
+    int same;
+
+    if (f == NULL) {
+        return 0;
+    }
+    same = fread(word, sizeof(word), 1, f) == 1;
+    fclose(f);
+    memcpy(&quantum, &word[4], sizeof(quantum));
+    return same && memcmp(&word[0], file_magic, sizeof(word[0])) == 0
+        && word[1] == t->np && word[2] == t->nd && word[3] == t->flags
+        && quantum == t->quantum;
+}
+
+trajectory *trajectory_open(const char *path, int np, int nd, double quantum,
+                            int compress, int append)
+{
+    trajectory *t = calloc(1, sizeof(trajectory));
+    int64_t word[WORDS];
+    size_t values = 2L * np * nd;
+    FILE *f;
+
+    if (t == NULL) {
+        fprintf(stderr, "trajectory: out of memory\n");
+        exit(1);
+    }
+    t->np = np;
+    t->nd = nd;
+    t->quantum = quantum > 0.0 ? quantum : 0.0;
+    t->flags = quantum > 0.0 ? TRAJECTORY_QUANTIZED : 0;
+#ifdef HAVE_ZLIB
+    if (compress) {
+        t->flags |= TRAJECTORY_ZLIB;
+    }
+#else
+    if (compress) {
+        fprintf(stderr,
+                "trajectory: built without zlib, frames are not compressed\n");
+    }
+#endif
+
+    if (!append || !same_header(path, t)) {
+        memcpy(&word[0], file_magic, sizeof(word[0]));
+        word[1] = np;
+        word[2] = nd;
+        word[3] = t->flags;
+        memcpy(&word[4], &t->quantum, sizeof(word[4]));
+        if ((f = fopen(path, "wb")) == NULL
+            || fwrite(word, sizeof(word), 1, f) != 1 || fclose(f) != 0) {
+            fprintf(stderr, "trajectory: cannot write %s\n", path);
+            free(t);
+            return NULL;
+        }
+    }
+
+    /* A varint takes at most 10 bytes. */
+    t->payload_max = values * (t->flags & TRAJECTORY_QUANTIZED ? 10 : 8);
+    t->frame_max = sizeof(word) + t->payload_max;
+#ifdef HAVE_ZLIB
+    if (t->flags & TRAJECTORY_ZLIB) {
+        size_t bound = compressBound(t->payload_max);
+
+        t->payload = allocate(t->payload_max);
+        if (bound > t->payload_max) {
+            t->frame_max = sizeof(word) + bound;
+        }
+    }
+#endif
+    t->frame = allocate(t->frame_max);
+    t->prev = allocate(values * sizeof(uint64_t));
+    t->path = allocate(strlen(path) + 1);
+    strcpy(t->path, path);
+
+    t->io = async_io_create();
+    async_io_set_filter(t->io, encode, t);
+    return t;
+}
+
+void trajectory_write(trajectory *t, int step, const double *pos,
+                      const double *vel, int ld, int soa)
+{
+    double time = omp_get_wtime();
+    int64_t head[4];
+    size_t count = (size_t) ld * (soa ? t->nd : t->np);
+
+    head[0] = step;
+    head[1] = ld;
+    head[2] = soa;
+    head[3] = 0;
+
+    async_io_begin_append(t->io, t->path);
+    async_io_append(t->io, head, sizeof(head));
+    async_io_append(t->io, pos, count * sizeof(double));
+    async_io_append(t->io, vel, count * sizeof(double));
+    async_io_commit(t->io);
+
+    t->call_seconds += omp_get_wtime() - time;
+}
+
+int trajectory_close(trajectory *t, double stats[6])
+{
+    async_io_stats io_stats;
+    int errors;
+
+    errors = async_io_wait(t->io);
+    async_io_get_stats(t->io, &io_stats);
+    async_io_destroy(t->io);
+
+    stats[0] = io_stats.files;
+    stats[1] = io_stats.files * 2.0 * t->np * t->nd * sizeof(double);
+    stats[2] = io_stats.bytes;
+    stats[3] = t->encode_seconds;
+    stats[4] = io_stats.write_seconds;
+    stats[5] = t->call_seconds;
+
+    free(t->path);
+    free(t->prev);
+    free(t->frame);
+    free(t->payload);
+    free(t);
+    return errors;
+}
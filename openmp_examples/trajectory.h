@@ -0,0 +1,68 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+/*
+ * A binary trajectory of particle positions and velocities, encoded and
+ * written by the background thread of async_io.h.
+ *
+ * The file starts with five 8 byte words: the magic number "MDTRAJ01",
+ * NP and ND as 64 bit integers, the flags below, and the quantum as a
+ * double.  Each frame then has five 64 bit integers: the magic number
+ * "MDFRAME1", the step, its flags, the size of the payload before
+ * compression and its size in the file; then the payload.  All numbers
+ * are in the byte order of the machine that wrote the file.
+ *
+ * The payload holds the 2*ND*NP values of the frame component by
+ * component: the first coordinate of all particles, then the second, and
+ * so on, then the velocities in the same way.
+ *
+ *   QUANTIZED: each value is rounded to a multiple Q*QUANTUM, and Q is
+ *   stored as a zigzag varint (7 bits per byte, low bits first).
+ *   Otherwise the values are stored as doubles, without loss.
+ *
+ *   DELTA: each value is stored as its change from the previous frame:
+ *   the difference of the Q's, or the XOR of the doubles' bits.  Every
+ *   KEYFRAME frames, and in the first frame written by a run, the values
+ *   are stored as they are, so that a reader may start there.
+ *
+ *   ZLIB: the payload is compressed with zlib (an LZ77 coder) at its
+ *   fastest level.  Only available when compiled with -DHAVE_ZLIB.
+ *
+ * The calling thread only copies the arrays into a free buffer; the
+ * encoding, the compression and the writing happen in the writer thread,
+ * while the next steps are computed.
+ */
+#define TRAJECTORY_QUANTIZED 1
+#define TRAJECTORY_DELTA 2
+#define TRAJECTORY_ZLIB 4
+
+#define TRAJECTORY_KEYFRAME 64
+
+typedef struct trajectory trajectory;
+
+/*
+ * Open PATH for the trajectory of NP particles in ND dimensions; QUANTUM
+ * is 0 for lossless frames.  With APPEND, frames are added to an existing
+ * file for the same NP, ND and QUANTUM, as after a restart; otherwise the
+ * file is replaced.  Returns NULL if PATH cannot be written.
+ */
+trajectory *trajectory_open(const char *path, int np, int nd, double quantum,
+                            int compress, int append);
+
+/*
+ * Queue the frame of STEP.  POS and VEL are ND by NP Fortran arrays
+ * with leading dimension LD, or, if SOA, NP by ND with leading dimension
+ * LD.
+ */
+void trajectory_write(trajectory *t, int step, const double *pos,
+                      const double *vel, int ld, int soa);
+
+/*
+ * Wait for the frames, close the trajectory and return its errors.
+ * STATS gets the frames written, the bytes of the frames as doubles, the
+ * bytes written, the seconds the writer thread spent encoding and
+ * writing, and the seconds trajectory_write() took, waits included.
+ */
+int trajectory_close(trajectory *t, double stats[6]);
+
+#endif